@@ -0,0 +1,225 @@
+#include "BVH.h"
+
+#include <algorithm>
+
+namespace dae
+{
+	void BVH::Build(const std::vector<AABB>& primitiveBounds)
+	{
+		const uint32_t primitiveCount{ static_cast<uint32_t>(primitiveBounds.size()) };
+
+		m_Nodes.clear();
+		m_PrimitiveIndices.clear();
+		m_NodesUsed = 0;
+
+		if (primitiveCount == 0)
+			return;
+
+		//A binary tree with N leaves never needs more than 2N - 1 nodes
+		m_Nodes.resize(2 * static_cast<size_t>(primitiveCount) - 1);
+		m_PrimitiveIndices.resize(primitiveCount);
+
+		std::vector<Vector3> centers{};
+		centers.reserve(primitiveCount);
+		for (uint32_t i{ 0 }; i < primitiveCount; ++i)
+		{
+			m_PrimitiveIndices[i] = i;
+			centers.emplace_back(primitiveBounds[i].GetCenter());
+		}
+
+		BVHNode& root{ m_Nodes[0] };
+		root.leftFirst = 0;
+		root.primitiveCount = primitiveCount;
+		m_NodesUsed = 1;
+
+		UpdateNodeBounds(root, primitiveBounds);
+		Subdivide(0, primitiveBounds, centers, 1);
+
+		m_Nodes.resize(m_NodesUsed);
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primitiveBounds)
+	{
+		if (m_Nodes.empty())
+			return;
+
+		//Children are always stored after their parent, so a reverse sweep visits them first
+		for (int nodeIndex{ static_cast<int>(m_Nodes.size()) - 1 }; nodeIndex >= 0; --nodeIndex)
+		{
+			BVHNode& node{ m_Nodes[nodeIndex] };
+			if (node.IsLeaf())
+			{
+				UpdateNodeBounds(node, primitiveBounds);
+				continue;
+			}
+
+			node.bounds = m_Nodes[node.leftFirst].bounds;
+			node.bounds.Grow(m_Nodes[node.leftFirst + 1].bounds);
+		}
+	}
+
+	bool BVH::Restore(const BVHNode* pNodes, uint32_t numNodes, const uint32_t* pPrimitiveIndices, uint32_t numPrimitives)
+	{
+		m_Nodes.assign(pNodes, pNodes + numNodes);
+		m_PrimitiveIndices.assign(pPrimitiveIndices, pPrimitiveIndices + numPrimitives);
+		m_NodesUsed = numNodes;
+
+		//Traversal and Refit index without bounds checks, so every reference is checked once here
+		//Children have to come after their parent, like Build stores them, which also rules out cycles
+		//Traversal stacks are sized for MaxDepth, so a deeper tree is rejected as well, depth 0 marks a node no parent reached yet
+		bool isValid{ std::all_of(m_PrimitiveIndices.begin(), m_PrimitiveIndices.end(), [numPrimitives](uint32_t index) { return index < numPrimitives; }) };
+		std::vector<uint8_t> depths(numNodes, 0);
+		if (numNodes > 0)
+			depths[0] = 1;
+
+		for (uint32_t nodeIndex{ 0 }; nodeIndex < numNodes && isValid; ++nodeIndex)
+		{
+			const BVHNode& node{ m_Nodes[nodeIndex] };
+			if (node.IsLeaf())
+			{
+				isValid = static_cast<uint64_t>(node.leftFirst) + node.primitiveCount <= numPrimitives;
+				continue;
+			}
+
+			isValid = node.leftFirst > nodeIndex && static_cast<uint64_t>(node.leftFirst) + 1 < numNodes
+				&& depths[nodeIndex] > 0 && depths[nodeIndex] < MaxDepth
+				&& depths[node.leftFirst] == 0 && depths[node.leftFirst + 1] == 0;
+			if (isValid)
+			{
+				depths[node.leftFirst] = static_cast<uint8_t>(depths[nodeIndex] + 1);
+				depths[node.leftFirst + 1] = static_cast<uint8_t>(depths[nodeIndex] + 1);
+			}
+		}
+
+		if (!isValid)
+		{
+			m_Nodes.clear();
+			m_PrimitiveIndices.clear();
+			m_NodesUsed = 0;
+		}
+		return isValid;
+	}
+
+	void BVH::UpdateNodeBounds(BVHNode& node, const std::vector<AABB>& primitiveBounds) const
+	{
+		node.bounds = AABB{};
+		for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+		{
+			node.bounds.Grow(primitiveBounds[m_PrimitiveIndices[node.leftFirst + i]]);
+		}
+	}
+
+	void BVH::Subdivide(uint32_t nodeIndex, const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>& centers, int depth)
+	{
+		BVHNode& node{ m_Nodes[nodeIndex] };
+		if (node.primitiveCount <= 1 || depth >= MaxDepth)
+			return;
+
+		//Only split when the SAH says it is cheaper than intersecting every primitive in this node
+		int axis{};
+		float splitPosition{};
+		const float splitCost{ FindBestSplit(node, primitiveBounds, centers, axis, splitPosition) };
+		const float leafCost{ node.primitiveCount * node.bounds.GetSurfaceArea() };
+		if (splitCost >= leafCost)
+			return;
+
+		//Partition the primitives in place around the split plane
+		int i{ static_cast<int>(node.leftFirst) };
+		int j{ i + static_cast<int>(node.primitiveCount) - 1 };
+		while (i <= j)
+		{
+			if (centers[m_PrimitiveIndices[i]][axis] < splitPosition)
+				++i;
+			else
+				std::swap(m_PrimitiveIndices[i], m_PrimitiveIndices[j--]);
+		}
+
+		const uint32_t leftCount{ i - node.leftFirst };
+		if (leftCount == 0 || leftCount == node.primitiveCount)
+			return;
+
+		const uint32_t leftChildIndex{ m_NodesUsed++ };
+		const uint32_t rightChildIndex{ m_NodesUsed++ };
+
+		m_Nodes[leftChildIndex].leftFirst = node.leftFirst;
+		m_Nodes[leftChildIndex].primitiveCount = leftCount;
+		m_Nodes[rightChildIndex].leftFirst = i;
+		m_Nodes[rightChildIndex].primitiveCount = node.primitiveCount - leftCount;
+
+		node.leftFirst = leftChildIndex;
+		node.primitiveCount = 0;
+
+		UpdateNodeBounds(m_Nodes[leftChildIndex], primitiveBounds);
+		UpdateNodeBounds(m_Nodes[rightChildIndex], primitiveBounds);
+
+		Subdivide(leftChildIndex, primitiveBounds, centers, depth + 1);
+		Subdivide(rightChildIndex, primitiveBounds, centers, depth + 1);
+	}
+
+	float BVH::FindBestSplit(const BVHNode& node, const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>& centers, int& axis, float& splitPosition) const
+	{
+		struct Bin
+		{
+			AABB bounds{};
+			uint32_t primitiveCount{};
+		};
+
+		//Bin over the centroid bounds, the node bounds can be much larger than the spread of centers
+		AABB centerBounds{};
+		for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+		{
+			centerBounds.Grow(centers[m_PrimitiveIndices[node.leftFirst + i]]);
+		}
+
+		float bestCost{ FLT_MAX };
+		for (int a{ 0 }; a < 3; ++a)
+		{
+			const float boundsMin{ centerBounds.min[a] };
+			const float boundsMax{ centerBounds.max[a] };
+			if (boundsMin == boundsMax)
+				continue;
+
+			Bin bins[NumBins]{};
+			const float scale{ NumBins / (boundsMax - boundsMin) };
+			for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+			{
+				const uint32_t primitiveIndex{ m_PrimitiveIndices[node.leftFirst + i] };
+				const int binIndex{ std::min(NumBins - 1, static_cast<int>((centers[primitiveIndex][a] - boundsMin) * scale)) };
+				++bins[binIndex].primitiveCount;
+				bins[binIndex].bounds.Grow(primitiveBounds[primitiveIndex]);
+			}
+
+			//Sweep from both sides to gather the area and count on each side of every bin boundary
+			float leftArea[NumBins - 1]{}, rightArea[NumBins - 1]{};
+			uint32_t leftCount[NumBins - 1]{}, rightCount[NumBins - 1]{};
+			AABB leftBox{}, rightBox{};
+			uint32_t leftSum{}, rightSum{};
+			for (int b{ 0 }; b < NumBins - 1; ++b)
+			{
+				leftSum += bins[b].primitiveCount;
+				leftCount[b] = leftSum;
+				leftBox.Grow(bins[b].bounds);
+				leftArea[b] = leftBox.GetSurfaceArea();
+
+				rightSum += bins[NumBins - 1 - b].primitiveCount;
+				rightCount[NumBins - 2 - b] = rightSum;
+				rightBox.Grow(bins[NumBins - 1 - b].bounds);
+				rightArea[NumBins - 2 - b] = rightBox.GetSurfaceArea();
+			}
+
+			const float binWidth{ (boundsMax - boundsMin) / NumBins };
+			for (int b{ 0 }; b < NumBins - 1; ++b)
+			{
+				const float cost{ leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b] };
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					axis = a;
+					splitPosition = boundsMin + binWidth * (b + 1);
+				}
+			}
+		}
+
+		return bestCost;
+	}
+}
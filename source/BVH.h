@@ -0,0 +1,118 @@
+#pragma once
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	struct AABB
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& point)
+		{
+			min = Vector3::Min(min, point);
+			max = Vector3::Max(max, point);
+		}
+
+		void Grow(const AABB& other)
+		{
+			min = Vector3::Min(min, other.min);
+			max = Vector3::Max(max, other.max);
+		}
+
+		Vector3 GetCenter() const
+		{
+			return (min + max) * 0.5f;
+		}
+
+		//Bounds of this box after transforming all eight of its corners
+		AABB Transformed(const Matrix& transform) const
+		{
+			AABB result{};
+			if (min.x > max.x)
+				return result;
+
+			for (int corner{ 0 }; corner < 8; ++corner)
+			{
+				result.Grow(transform.TransformPoint(
+					(corner & 1) ? max.x : min.x,
+					(corner & 2) ? max.y : min.y,
+					(corner & 4) ? max.z : min.z));
+			}
+			return result;
+		}
+
+		float GetSurfaceArea() const
+		{
+			if (min.x > max.x)
+				return 0.f;
+
+			const Vector3 extents{ max - min };
+			return extents.x * extents.y + extents.y * extents.z + extents.z * extents.x;
+		}
+	};
+
+	struct BVHNode
+	{
+		AABB bounds{};
+		uint32_t leftFirst{}; //Left child for interior nodes, first primitive for leaves
+		uint32_t primitiveCount{};
+
+		bool IsLeaf() const { return primitiveCount > 0; }
+	};
+
+	//Bounding Volume Hierarchy over a list of primitive bounds, split using the Surface Area Heuristic
+	//Primitives are referenced by their index in the bounds list used to build it
+	class BVH final
+	{
+	public:
+		BVH() = default;
+
+		/**
+		 * \brief Rebuilds the hierarchy from scratch (binned SAH)
+		 * \param primitiveBounds bounds of every primitive, indexed by primitive id
+		 */
+		void Build(const std::vector<AABB>& primitiveBounds);
+
+		/**
+		 * \brief Recalculates the node bounds bottom-up, keeping the existing topology
+		 * \param primitiveBounds bounds of every primitive, must match the primitive count used to build
+		 */
+		void Refit(const std::vector<AABB>& primitiveBounds);
+
+		/**
+		 * \brief Takes over a hierarchy built earlier, for example one stored in a mesh cache
+		 * \param pNodes nodes in the order Build creates them, the root first
+		 * \param pPrimitiveIndices primitive ids in leaf order
+		 * \return false and leaves the hierarchy empty when a node references a node or primitive that does not exist
+		 */
+		bool Restore(const BVHNode* pNodes, uint32_t numNodes, const uint32_t* pPrimitiveIndices, uint32_t numPrimitives);
+
+		bool IsEmpty() const { return m_Nodes.empty(); }
+		AABB GetBounds() const { return m_Nodes.empty() ? AABB{} : m_Nodes[0].bounds; }
+		uint32_t GetPrimitiveCount() const { return static_cast<uint32_t>(m_PrimitiveIndices.size()); }
+		const std::vector<BVHNode>& GetNodes() const { return m_Nodes; }
+		const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+
+		static constexpr int MaxDepth{ 64 }; //Levels including the root, leaves are at most this deep
+
+		//Expanding an interior node at depth d leaves at most one sibling pending for each of the d - 1 levels below the root and pushes 2 children,
+		//interior nodes are at most MaxDepth - 1 deep, Build stops there and Restore rejects deeper ones, so d + 1 never exceeds MaxDepth
+		static constexpr int MaxStackSize{ MaxDepth };
+
+	private:
+		void UpdateNodeBounds(BVHNode& node, const std::vector<AABB>& primitiveBounds) const;
+		void Subdivide(uint32_t nodeIndex, const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>& centers, int depth);
+		float FindBestSplit(const BVHNode& node, const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>& centers, int& axis, float& splitPosition) const;
+
+		static constexpr int NumBins{ 16 };
+
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<uint32_t> m_PrimitiveIndices{};
+		uint32_t m_NodesUsed{};
+	};
+}
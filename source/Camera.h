@@ -35,6 +35,9 @@ namespace dae
 
 		Matrix cameraToWorld{};
 
+		//Set by Update when the origin, orientation or field of view changed this frame
+		bool hasMoved{ false };
+
 		void ChangeFOV(const float& _fovAngle)
 		{
 			fovAngle = _fovAngle;
@@ -59,6 +62,10 @@ namespace dae
 
 		void Update(Timer* pTimer)
 		{
+			const Vector3 previousOrigin{ origin };
+			const Vector3 previousForward{ forward };
+			const float previousFovAngle{ fovAngle };
+
 			const float deltaTime{ pTimer->GetElapsed() };
 			const float defVelocity{ 10.f };
 			float velocity{ 10.f };
@@ -178,6 +185,10 @@ namespace dae
 				//		forward.y = -lookConstraint;
 				//	}
 			}
+
+			hasMoved = (origin - previousOrigin).SqrMagnitude() > 0.f
+				|| (forward - previousForward).SqrMagnitude() > 0.f
+				|| fovAngle != previousFovAngle;
 		}
 	};
 }
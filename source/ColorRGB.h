@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+
 #include "MathHelpers.h"
 
 namespace dae
@@ -9,20 +11,27 @@ namespace dae
 		float g{};
 		float b{};
 
-		void MaxToOne()
+		constexpr void MaxToOne()
 		{
 			const float maxValue = std::max(r, std::max(g, b));
 			if (maxValue > 1.f)
 				*this /= maxValue;
 		}
 
-		static ColorRGB Lerp(const ColorRGB& c1, const ColorRGB& c2, float factor)
+		//Perceived brightness of a linear color (Rec. 709 weights)
+		constexpr float Luminance() const
+		{
+			return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+		}
+
+		static constexpr ColorRGB Lerp(const ColorRGB& c1, const ColorRGB& c2, float factor)
 		{
 			return { Lerpf(c1.r, c2.r, factor), Lerpf(c1.g, c2.g, factor), Lerpf(c1.b, c2.b, factor) };
 		}
 
 		#pragma region ColorRGB (Member) Operators
-		const ColorRGB& operator+=(const ColorRGB& c)
+		//Binary operators never modify their left operand, only the compound assignments do
+		constexpr ColorRGB& operator+=(const ColorRGB& c)
 		{
 			r += c.r;
 			g += c.g;
@@ -31,17 +40,12 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator+(const ColorRGB& c)
-		{
-			return *this += c;
-		}
-
-		ColorRGB operator+(const ColorRGB& c) const
+		constexpr ColorRGB operator+(const ColorRGB& c) const
 		{
 			return { r + c.r, g + c.g, b + c.b };
 		}
 
-		const ColorRGB& operator-=(const ColorRGB& c)
+		constexpr ColorRGB& operator-=(const ColorRGB& c)
 		{
 			r -= c.r;
 			g -= c.g;
@@ -50,17 +54,12 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator-(const ColorRGB& c)
-		{
-			return *this -= c;
-		}
-
-		ColorRGB operator-(const ColorRGB& c) const
+		constexpr ColorRGB operator-(const ColorRGB& c) const
 		{
 			return { r - c.r, g - c.g, b - c.b };
 		}
 
-		const ColorRGB& operator*=(const ColorRGB& c)
+		constexpr ColorRGB& operator*=(const ColorRGB& c)
 		{
 			r *= c.r;
 			g *= c.g;
@@ -69,17 +68,12 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator*(const ColorRGB& c)
-		{
-			return *this *= c;
-		}
-
-		ColorRGB operator*(const ColorRGB& c) const
+		constexpr ColorRGB operator*(const ColorRGB& c) const
 		{
 			return { r * c.r, g * c.g, b * c.b };
 		}
 
-		const ColorRGB& operator/=(const ColorRGB& c)
+		constexpr ColorRGB& operator/=(const ColorRGB& c)
 		{
 			r /= c.r;
 			g /= c.g;
@@ -88,12 +82,12 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator/(const ColorRGB& c)
+		constexpr ColorRGB operator/(const ColorRGB& c) const
 		{
-			return *this /= c;
+			return { r / c.r, g / c.g, b / c.b };
 		}
 
-		const ColorRGB& operator*=(float s)
+		constexpr ColorRGB& operator*=(float s)
 		{
 			r *= s;
 			g *= s;
@@ -102,17 +96,12 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator*(float s)
-		{
-			return *this *= s;
-		}
-
-		ColorRGB operator*(float s) const
+		constexpr ColorRGB operator*(float s) const
 		{
 			return { r * s, g * s,b * s };
 		}
 
-		const ColorRGB& operator/=(float s)
+		constexpr ColorRGB& operator/=(float s)
 		{
 			r /= s;
 			g /= s;
@@ -121,29 +110,29 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator/(float s)
+		constexpr ColorRGB operator/(float s) const
 		{
-			return *this /= s;
+			return { r / s, g / s, b / s };
 		}
 		#pragma endregion
 	};
 
 	//ColorRGB (Global) Operators
-	inline ColorRGB operator*(float s, const ColorRGB& c)
+	constexpr ColorRGB operator*(float s, const ColorRGB& c)
 	{
 		return c * s;
 	}
 
 	namespace colors
 	{
-		static ColorRGB Red{ 1,0,0 };
-		static ColorRGB Blue{ 0,0,1 };
-		static ColorRGB Green{ 0,1,0 };
-		static ColorRGB Yellow{ 1,1,0 };
-		static ColorRGB Cyan{ 0,1,1 };
-		static ColorRGB Magenta{ 1,0,1 };
-		static ColorRGB White{ 1,1,1 };
-		static ColorRGB Black{ 0,0,0 };
-		static ColorRGB Gray{ 0.5f,0.5f,0.5f };
+		inline constexpr ColorRGB Red{ 1,0,0 };
+		inline constexpr ColorRGB Blue{ 0,0,1 };
+		inline constexpr ColorRGB Green{ 0,1,0 };
+		inline constexpr ColorRGB Yellow{ 1,1,0 };
+		inline constexpr ColorRGB Cyan{ 0,1,1 };
+		inline constexpr ColorRGB Magenta{ 1,0,1 };
+		inline constexpr ColorRGB White{ 1,1,1 };
+		inline constexpr ColorRGB Black{ 0,0,0 };
+		inline constexpr ColorRGB Gray{ 0.5f,0.5f,0.5f };
 	}
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace dae
+{
+	namespace
+	{
+		bool DetectAVX2()
+		{
+#if defined(_MSC_VER)
+			int info[4]{};
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+
+			//Leaf 1 ECX: bit 12 FMA, bit 27 OSXSAVE, bit 28 AVX
+			__cpuid(info, 1);
+			const bool hasFMA{ (info[2] & (1 << 12)) != 0 };
+			const bool hasOSXSave{ (info[2] & (1 << 27)) != 0 };
+			const bool hasAVX{ (info[2] & (1 << 28)) != 0 };
+			if (!hasFMA || !hasOSXSave || !hasAVX)
+				return false;
+
+			//XCR0 bits 1 and 2: the OS preserves the SSE and AVX state
+			if ((_xgetbv(0) & 0x6) != 0x6)
+				return false;
+
+			//Leaf 7 EBX: bit 5 AVX2
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+			return false;
+#endif
+		}
+	}
+
+	bool CpuFeatures::HasAVX2()
+	{
+		static const bool hasAVX2{ DetectAVX2() };
+		return hasAVX2;
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+namespace dae
+{
+	//Instruction set extensions the renderer can pick specialized kernels for, queried once and cached
+	namespace CpuFeatures
+	{
+		//AVX2 together with FMA, the OS also has to save the 256-bit registers on a context switch
+		bool HasAVX2();
+	}
+}
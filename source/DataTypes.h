@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Math.h"
+#include "BVH.h"
+#include "ThreadPool.h"
 #include "vector"
 
 namespace dae
@@ -53,6 +55,22 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
+	//Triangle in the form the Moller-Trumbore test consumes, built once per transform update instead of once per ray
+	struct PrecomputedTriangle
+	{
+		PrecomputedTriangle() = default;
+		PrecomputedTriangle(const Vector3& _v0, const Vector3& _v1, const Vector3& _v2) :
+			v0{ _v0 }, edge1{ _v1 - _v0 }, edge2{ _v2 - _v0 }, normal{ Vector3::Cross(edge1, edge2).Normalized() } {}
+		PrecomputedTriangle(const Vector3& _v0, const Vector3& _v1, const Vector3& _v2, const Vector3& _normal) :
+			v0{ _v0 }, edge1{ _v1 - _v0 }, edge2{ _v2 - _v0 }, normal{ _normal } {}
+
+		Vector3 v0{};
+		Vector3 edge1{};
+		Vector3 edge2{};
+
+		Vector3 normal{};
+	};
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -90,7 +108,17 @@ namespace dae
 		Vector3 transformedMaxAABB;
 
 		std::vector<Vector3> transformedPositions{};
-		std::vector<Vector3> transformedNormals{};
+		std::vector<Vector3> transformedNormals{}; //One per triangle, like normals
+
+		//One entry per index triple, rebuilt together with transformedPositions
+		std::vector<PrecomputedTriangle> triangles{};
+		std::vector<AABB> triangleBounds{};
+
+		//Acceleration structure over the transformed triangles
+		BVH bvh{};
+
+		//Vertices and triangles per ParallelFor item, large enough that claiming an item costs nothing next to transforming it
+		static constexpr uint32_t UpdateBatchSize{ 2048 };
 
 		void Translate(const Vector3& translation)
 		{
@@ -138,43 +166,90 @@ namespace dae
 			}
 		}
 
-		void UpdateTransforms()
+		/**
+		 * \brief Transforms the vertices and face normals, then rebuilds the triangles and refits the BVH
+		 * \param pThreadPool splits the work over its threads, nullptr runs everything on the calling thread
+		 */
+		void UpdateTransforms(ThreadPool* pThreadPool = nullptr)
 		{
-			//assert(false && "No Implemented Yet!");
+			const uint32_t numVertices{ static_cast<uint32_t>(positions.size()) };
+			const uint32_t numTriangles{ static_cast<uint32_t>(indices.size() / 3) };
+
+			//Meshes built without face normals get them once, every later update transforms them instead of recomputing them
+			if (normals.size() != numTriangles)
+			{
+				normals.clear();
+				CalculateNormals();
+			}
 
-			transformedPositions.clear();
-			transformedNormals.clear();
-			transformedPositions.reserve(positions.size());
-			transformedNormals.reserve(normals.size());
-			
+			//Same size every frame for an animated mesh, so these only allocate on the first update
+			transformedPositions.resize(numVertices);
+			transformedNormals.resize(numTriangles);
+			triangles.resize(numTriangles);
+			triangleBounds.resize(numTriangles);
 
 			//Calculate Final Transform
-			const auto finalTransform = scaleTransform * rotationTransform * translationTransform;
+			const Matrix finalTransform{ scaleTransform * rotationTransform * translationTransform };
+
+			//Normals go to world space with the inverse-transpose
+			const Matrix normalTransform{ Matrix::Transpose(Matrix::InverseAffine(finalTransform)) };
 
-			//Transform Positions (positions > transformedPositions)
-			//...
-			for (auto& position : positions)
+			//Vertices first, the triangles of any batch can reference any vertex
+			//The captures are kept small so wrapping the lambdas in the std::function of ParallelFor does not allocate
+			const auto transformVertices{ [this, &finalTransform, numVertices](uint32_t batchIndex)
 			{
-				transformedPositions.emplace_back(finalTransform.TransformPoint(position));
-			}
+				const uint32_t first{ batchIndex * UpdateBatchSize };
+				const uint32_t count{ std::min(UpdateBatchSize, numVertices - first) };
+				finalTransform.TransformPoints(&positions[first], &transformedPositions[first], count);
+			} };
 
-			//Transform Normals (normals > transformedNormals)
-			//...
-			for (int i = 0; i < indices.size(); i += 3)
+			const auto updateTriangles{ [this, &normalTransform, numTriangles](uint32_t batchIndex)
 			{
-				const Vector3 a{ transformedPositions[indices[i + 1]] - transformedPositions[indices[i]] };
-				const Vector3 b{ transformedPositions[indices[i + 2]] - transformedPositions[indices[i]] };
-				
-				const Vector3 normal{ Vector3::Cross(a, b).Normalized() };
-				transformedNormals.emplace_back(normal);
-			}
+				const uint32_t first{ batchIndex * UpdateBatchSize };
+				const uint32_t end{ std::min(first + UpdateBatchSize, numTriangles) };
+				normalTransform.TransformNormals(&normals[first], &transformedNormals[first], end - first);
+
+				for (uint32_t i{ first }; i < end; ++i)
+				{
+					const Vector3& v0{ transformedPositions[indices[i * 3]] };
+					const Vector3& v1{ transformedPositions[indices[i * 3 + 1]] };
+					const Vector3& v2{ transformedPositions[indices[i * 3 + 2]] };
+					triangles[i] = PrecomputedTriangle{ v0, v1, v2, transformedNormals[i] };
+
+					AABB& bounds{ triangleBounds[i] };
+					bounds = AABB{};
+					bounds.Grow(v0);
+					bounds.Grow(v1);
+					bounds.Grow(v2);
+				}
+			} };
 
-			for (const auto& p : positions)
+			const uint32_t numVertexBatches{ (numVertices + UpdateBatchSize - 1) / UpdateBatchSize };
+			const uint32_t numTriangleBatches{ (numTriangles + UpdateBatchSize - 1) / UpdateBatchSize };
+			if (pThreadPool)
+			{
+				pThreadPool->ParallelFor(numVertexBatches, transformVertices);
+				pThreadPool->ParallelFor(numTriangleBatches, updateTriangles);
+			}
+			else
 			{
-				transformedPositions.emplace_back(finalTransform.TransformPoint(p));
+				for (uint32_t i{ 0 }; i < numVertexBatches; ++i)
+					transformVertices(i);
+				for (uint32_t i{ 0 }; i < numTriangleBatches; ++i)
+					updateTriangles(i);
 			}
 
 			UpdateTransformedAABB(finalTransform);
+			UpdateBVH();
+		}
+
+		void UpdateBVH()
+		{
+			//Only the vertices moved when the triangle count is unchanged, refitting keeps the topology
+			if (bvh.GetPrimitiveCount() == triangleBounds.size())
+				bvh.Refit(triangleBounds);
+			else
+				bvh.Build(triangleBounds);
 		}
 
 		void UpdateAABB()
@@ -228,6 +303,53 @@ namespace dae
 			transformedMaxAABB = tMaxAABB;
 		}
 	};
+
+	//Places a shared TriangleMesh in the world without copying or transforming its vertices
+	//Rays are moved into the object space of the mesh instead, so every instance reuses the BVH of that mesh
+	struct TriangleMeshInstance
+	{
+		const TriangleMesh* pMesh{ nullptr };
+		unsigned char materialIndex{};
+
+		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
+
+		Matrix rotationTransform{};
+		Matrix translationTransform{};
+		Matrix scaleTransform{};
+
+		Matrix objectToWorld{};
+		Matrix worldToObject{};
+		Matrix normalToWorld{};
+
+		AABB transformedBounds{};
+
+		void Translate(const Vector3& translation)
+		{
+			translationTransform = Matrix::CreateTranslation(translation);
+		}
+
+		void RotateY(float yaw)
+		{
+			rotationTransform = Matrix::CreateRotationY(-yaw); //Inverse to make rotation correct
+		}
+
+		void Scale(const Vector3& scale)
+		{
+			scaleTransform = Matrix::CreateScale(scale);
+		}
+
+		void UpdateTransforms()
+		{
+			objectToWorld = scaleTransform * rotationTransform * translationTransform;
+
+			worldToObject = Matrix::InverseAffine(objectToWorld);
+
+			//Normals go back to world space with the inverse-transpose
+			normalToWorld = Matrix::Transpose(worldToObject);
+
+			transformedBounds = pMesh ? pMesh->bvh.GetBounds().Transformed(objectToWorld) : AABB{};
+		}
+	};
 #pragma endregion
 #pragma region LIGHT
 	enum class LightType
@@ -273,5 +395,16 @@ namespace dae
 		bool didHit{ false };
 		unsigned char materialIndex{ 0 };
 	};
+
+	//All a closest-hit search keeps per candidate, origin, normal and material are only resolved for the final hit
+	struct PrimitiveHit
+	{
+		float t{ FLT_MAX };
+		uint32_t primitiveIndex{}; //Triangle within a mesh or sphere within the scene
+
+		//Barycentric coordinates of the hit point, only set for triangles
+		float u{};
+		float v{};
+	};
 #pragma endregion
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+
+#include "LightTree.h"
+#include "Math.h"
+
+namespace dae
+{
+	//Weighted reservoir holding one light sample picked by resampled importance sampling (ReSTIR)
+	//Candidates are streamed in one at a time, each replaces the kept sample with a probability of its weight over the running weight sum
+	struct LightReservoir
+	{
+		uint32_t lightIndex{ LightTree::InvalidLight };
+		float u{};
+		float v{};
+
+		float targetPdf{}; //Unnormalized target density of the kept sample at the pixel owning the reservoir
+		float weightSum{};
+		float sampleCount{}; //Number of candidates this reservoir represents (M)
+		float contributionWeight{}; //Unbiased contribution weight of the kept sample (W)
+
+		//Surface the reservoir was built for, neighbours on a different surface are not reused
+		Vector3 normal{};
+		float hitDistance{};
+
+		bool IsValid() const { return lightIndex != LightTree::InvalidLight && contributionWeight > 0.f; }
+
+		/**
+		 * \brief Streams in one candidate
+		 * \param weight resampling weight of the candidate
+		 * \param random uniform random number in [0, 1)
+		 * \return true when the candidate replaced the kept sample
+		 */
+		bool Update(uint32_t candidateLight, float candidateU, float candidateV, float candidateTargetPdf, float weight, float random)
+		{
+			weightSum += weight;
+			sampleCount += 1.f;
+			if (weight <= 0.f || random * weightSum >= weight)
+				return false;
+
+			lightIndex = candidateLight;
+			u = candidateU;
+			v = candidateV;
+			targetPdf = candidateTargetPdf;
+			return true;
+		}
+
+		/**
+		 * \brief Merges another reservoir into this one, its sample competes with the weight it would have at this pixel
+		 * \param targetPdfHere target density of the other reservoir's sample evaluated at the pixel owning this reservoir
+		 */
+		bool Merge(const LightReservoir& other, float targetPdfHere, float random)
+		{
+			const float previousCount{ sampleCount };
+			const bool replaced{ Update(other.lightIndex, other.u, other.v, targetPdfHere, targetPdfHere * other.contributionWeight * other.sampleCount, random) };
+			sampleCount = previousCount + other.sampleCount;
+			return replaced;
+		}
+
+		//W = weightSum / (M * targetPdf), call once every candidate is streamed in
+		void FinalizeWeight()
+		{
+			contributionWeight = (targetPdf > 0.f && sampleCount > 0.f) ? weightSum / (sampleCount * targetPdf) : 0.f;
+		}
+	};
+}
@@ -0,0 +1,187 @@
+#include "LightTree.h"
+
+#include <algorithm>
+
+namespace dae
+{
+	void LightTree::Build(const std::vector<Light>& lights)
+	{
+		const uint32_t lightCount{ static_cast<uint32_t>(lights.size()) };
+
+		m_Nodes.clear();
+		m_LightIndices.clear();
+		m_NodesUsed = 0;
+
+		if (lightCount == 0)
+			return;
+
+		std::vector<AABB> lightBounds{};
+		std::vector<float> lightPower{};
+		lightBounds.reserve(lightCount);
+		lightPower.reserve(lightCount);
+		m_LightIndices.resize(lightCount);
+		for (uint32_t i{ 0 }; i < lightCount; ++i)
+		{
+			m_LightIndices[i] = i;
+			lightBounds.push_back(GetLightBounds(lights[i]));
+			lightPower.push_back(GetLightPower(lights[i]));
+		}
+
+		//Every leaf holds a single light, N leaves need 2N - 1 nodes
+		m_Nodes.resize(2 * static_cast<size_t>(lightCount) - 1);
+		m_NodesUsed = 1;
+		Subdivide(0, 0, lightCount, lightBounds, lightPower);
+	}
+
+	uint32_t LightTree::Sample(const Vector3& position, const Vector3& normal, float u, float& pdf) const
+	{
+		if (m_Nodes.empty())
+			return InvalidLight;
+
+		pdf = 1.f;
+		const LightTreeNode* pNode{ &m_Nodes[0] };
+		while (!pNode->IsLeaf())
+		{
+			const LightTreeNode& left{ m_Nodes[pNode->leftFirst] };
+			const LightTreeNode& right{ m_Nodes[pNode->leftFirst + 1] };
+
+			const float leftImportance{ GetImportance(left, position, normal) };
+			const float rightImportance{ GetImportance(right, position, normal) };
+			const float totalImportance{ leftImportance + rightImportance };
+			if (totalImportance <= 0.f)
+				return InvalidLight;
+
+			//The random number is rescaled after every choice so a single number is enough for the whole path
+			const float leftProbability{ leftImportance / totalImportance };
+			if (u < leftProbability)
+			{
+				u /= leftProbability;
+				pdf *= leftProbability;
+				pNode = &left;
+			}
+			else
+			{
+				u = (u - leftProbability) / (1.f - leftProbability);
+				pdf *= 1.f - leftProbability;
+				pNode = &right;
+			}
+			u = std::min(u, 0.99999994f);
+		}
+
+		return pNode->leftFirst;
+	}
+
+	void LightTree::Subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, const std::vector<AABB>& lightBounds, const std::vector<float>& lightPower)
+	{
+		LightTreeNode& node{ m_Nodes[nodeIndex] };
+		node.bounds = {};
+		node.power = 0.f;
+
+		AABB centerBounds{};
+		for (uint32_t i{ first }; i < first + count; ++i)
+		{
+			const uint32_t lightIndex{ m_LightIndices[i] };
+			node.bounds.Grow(lightBounds[lightIndex]);
+			node.power += lightPower[lightIndex];
+			centerBounds.Grow(lightBounds[lightIndex].GetCenter());
+		}
+
+		if (count == 1)
+		{
+			node.leftFirst = m_LightIndices[first];
+			node.lightCount = 1;
+			return;
+		}
+
+		const Vector3 extents{ centerBounds.max - centerBounds.min };
+		int axis{ 0 };
+		if (extents.y > extents.x)
+			axis = 1;
+		if (extents.z > extents[axis])
+			axis = 2;
+
+		//Median split, both halves get the same number of lights so the tree depth stays log2(N)
+		const uint32_t leftCount{ count / 2 };
+		std::nth_element(m_LightIndices.begin() + first, m_LightIndices.begin() + first + leftCount, m_LightIndices.begin() + first + count,
+			[&](uint32_t a, uint32_t b)
+			{
+				return lightBounds[a].GetCenter()[axis] < lightBounds[b].GetCenter()[axis];
+			});
+
+		const uint32_t leftChild{ m_NodesUsed };
+		m_NodesUsed += 2;
+		node.leftFirst = leftChild;
+		node.lightCount = 0;
+
+		Subdivide(leftChild, first, leftCount, lightBounds, lightPower);
+		Subdivide(leftChild + 1, first + leftCount, count - leftCount, lightBounds, lightPower);
+	}
+
+	float LightTree::GetImportance(const LightTreeNode& node, const Vector3& position, const Vector3& normal) const
+	{
+		//A surface only receives light from above its tangent plane, a box entirely below it cannot contribute
+		bool isAbove{ false };
+		for (int corner{ 0 }; corner < 8 && !isAbove; ++corner)
+		{
+			const Vector3 cornerPoint{
+				(corner & 1) ? node.bounds.max.x : node.bounds.min.x,
+				(corner & 2) ? node.bounds.max.y : node.bounds.min.y,
+				(corner & 4) ? node.bounds.max.z : node.bounds.min.z };
+			isAbove = Vector3::Dot(normal, cornerPoint - position) > 0.f;
+		}
+		if (!isAbove)
+			return 0.f;
+
+		//The distance is clamped to the size of the box, points inside or right next to a cluster would otherwise get an unbounded importance
+		const Vector3 halfExtents{ (node.bounds.max - node.bounds.min) * 0.5f };
+		const float distanceSq{ std::max({ (node.bounds.GetCenter() - position).SqrMagnitude(), halfExtents.SqrMagnitude(), 0.0001f }) };
+		return node.power / distanceSq;
+	}
+
+	AABB LightTree::GetLightBounds(const Light& light)
+	{
+		AABB bounds{};
+		switch (light.type)
+		{
+		case LightType::Point:
+		case LightType::Directional:
+			bounds.Grow(light.origin);
+			break;
+		case LightType::AreaRect:
+		{
+			const Vector3 halfRight{ light.right * (light.width * 0.5f) };
+			const Vector3 halfUp{ light.up * (light.height * 0.5f) };
+			bounds.Grow(light.origin - halfRight - halfUp);
+			bounds.Grow(light.origin - halfRight + halfUp);
+			bounds.Grow(light.origin + halfRight - halfUp);
+			bounds.Grow(light.origin + halfRight + halfUp);
+			break;
+		}
+		case LightType::AreaCircle:
+		{
+			//The height holds the radius for circle and sphere lights
+			const Vector3 right{ light.right * light.height };
+			const Vector3 up{ light.up * light.height };
+			bounds.Grow(light.origin - right - up);
+			bounds.Grow(light.origin - right + up);
+			bounds.Grow(light.origin + right - up);
+			bounds.Grow(light.origin + right + up);
+			break;
+		}
+		case LightType::AreaSphere:
+		{
+			const Vector3 extents{ light.height, light.height, light.height };
+			bounds.Grow(light.origin - extents);
+			bounds.Grow(light.origin + extents);
+			break;
+		}
+		}
+		return bounds;
+	}
+
+	float LightTree::GetLightPower(const Light& light)
+	{
+		//Luminance of the emitted color, a dim blue light should not be picked as often as an equally intense white one
+		return light.intensity * light.color.Luminance();
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "BVH.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	struct LightTreeNode
+	{
+		AABB bounds{};
+		float power{}; //Summed power of every light below this node
+		uint32_t leftFirst{}; //Left child for interior nodes, light index for leaves
+		uint32_t lightCount{};
+
+		bool IsLeaf() const { return lightCount > 0; }
+	};
+
+	//Binary hierarchy over the lights of a scene, used to pick lights in proportion to their estimated contribution
+	//Sampling walks a single path from the root, so picking a light costs O(log N) no matter how many lights there are
+	class LightTree final
+	{
+	public:
+		LightTree() = default;
+
+		/**
+		 * \brief Rebuilds the hierarchy, splitting the light positions at the median of their widest axis
+		 * \param lights lights of the scene, Sample returns indices into this list
+		 */
+		void Build(const std::vector<Light>& lights);
+
+		/**
+		 * \brief Picks one light with a probability proportional to its estimated contribution at a shading point
+		 * \param position shading point
+		 * \param normal surface normal at the shading point, lights completely below the surface are never picked
+		 * \param u uniform random number in [0, 1)
+		 * \param pdf probability the returned light was picked with
+		 * \return index of the picked light, InvalidLight when no light can contribute
+		 */
+		uint32_t Sample(const Vector3& position, const Vector3& normal, float u, float& pdf) const;
+
+		bool IsEmpty() const { return m_Nodes.empty(); }
+
+		static constexpr uint32_t InvalidLight{ UINT32_MAX };
+
+	private:
+		void Subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, const std::vector<AABB>& lightBounds, const std::vector<float>& lightPower);
+		float GetImportance(const LightTreeNode& node, const Vector3& position, const Vector3& normal) const;
+
+		static AABB GetLightBounds(const Light& light);
+		static float GetLightPower(const Light& light);
+
+		std::vector<LightTreeNode> m_Nodes{};
+		std::vector<uint32_t> m_LightIndices{};
+		uint32_t m_NodesUsed{};
+	};
+}
@@ -0,0 +1,70 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dae
+{
+	MappedFile::MappedFile(const std::string& filename)
+	{
+#if defined(_WIN32)
+		const HANDLE file{ CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		m_FileHandle = file;
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+			return;
+
+		m_MappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_MappingHandle)
+			return;
+
+		m_pData = static_cast<const char*>(MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0));
+		if (m_pData)
+			m_Size = static_cast<size_t>(size.QuadPart);
+#else
+		const int file{ open(filename.c_str(), O_RDONLY) };
+		if (file < 0)
+			return;
+
+		struct stat fileStat{};
+		if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+		{
+			void* pData{ mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0) };
+			if (pData != MAP_FAILED)
+			{
+				m_pData = static_cast<const char*>(pData);
+				m_Size = static_cast<size_t>(fileStat.st_size);
+			}
+		}
+
+		//The mapping keeps its own reference to the file
+		close(file);
+#endif
+	}
+
+	MappedFile::~MappedFile()
+	{
+#if defined(_WIN32)
+		if (m_pData)
+			UnmapViewOfFile(m_pData);
+		if (m_MappingHandle)
+			CloseHandle(m_MappingHandle);
+		if (m_FileHandle)
+			CloseHandle(m_FileHandle);
+#else
+		if (m_pData)
+			munmap(const_cast<char*>(m_pData), m_Size);
+#endif
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace dae
+{
+	//Read-only view of a whole file mapped into memory, the OS pages it in on first access instead of copying it into a buffer
+	class MappedFile final
+	{
+	public:
+		explicit MappedFile(const std::string& filename);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		//False when the file does not exist, cannot be read or is empty
+		bool IsOpen() const { return m_pData != nullptr; }
+
+		const char* GetData() const { return m_pData; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+		const char* m_pData{ nullptr };
+		size_t m_Size{ 0 };
+
+#if defined(_WIN32)
+		void* m_FileHandle{ nullptr };
+		void* m_MappingHandle{ nullptr };
+#endif
+	};
+}
@@ -1,7 +1,6 @@
 #pragma once
 #include "Math.h"
-#include "DataTypes.h"
-#include "BRDFs.h"
+#include "MaterialData.h"
 
 namespace dae
 {
@@ -18,13 +17,10 @@ namespace dae
 		Material& operator=(Material&&) noexcept = delete;
 
 		/**
-		 * \brief Function used to calculate the correct color for the specific material and its parameters
-		 * \param hitRecord current hitrecord
-		 * \param l light direction
-		 * \param v view direction
-		 * \return color
+		 * \brief Converts the material and its parameters into the flat representation the renderer shades with
+		 * \return material type and its precomputed BRDF constants
 		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+		virtual MaterialData Bake() const = 0;
 	};
 #pragma endregion
 
@@ -38,9 +34,12 @@ namespace dae
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
+		MaterialData Bake() const override
 		{
-			return m_Color;
+			MaterialData data{};
+			data.type = MaterialType::SolidColor;
+			data.diffuse = m_Color;
+			return data;
 		}
 
 	private:
@@ -57,9 +56,12 @@ namespace dae
 		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
 			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance){}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		MaterialData Bake() const override
 		{
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			MaterialData data{};
+			data.type = MaterialType::Lambert;
+			data.diffuse = BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			return data;
 		}
 
 	private:
@@ -80,9 +82,14 @@ namespace dae
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		MaterialData Bake() const override
 		{
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor) + BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, -v, hitRecord.normal);
+			MaterialData data{};
+			data.type = MaterialType::LambertPhong;
+			data.diffuse = BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			data.specularReflectance = m_SpecularReflectance;
+			data.phongExponent = m_PhongExponent;
+			return data;
 		}
 
 	private:
@@ -103,22 +110,17 @@ namespace dae
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		//The roughness terms of BRDF::NormalDistribution_GGX and BRDF::GeometryFunction_SchlickGGX are computed once here
+		MaterialData Bake() const override
 		{
-			const Vector3 normal{ hitRecord.normal };
-			const ColorRGB f0{ (!m_Metalness) ? ColorRGB(0.04, 0.04, 0.04) : m_Albedo };
-			const Vector3 halfVector{ ((v + l) / ((v + l).Magnitude())).Normalized() };
-
-			const ColorRGB F{ BRDF::FresnelFunction_Schlick(halfVector, v, f0) };
-			const float D{ BRDF::NormalDistribution_GGX(normal, halfVector, m_Roughness) };
-			const float G{ BRDF::GeometryFunction_Smith(normal, v, l, m_Roughness) };
-
-			const float c{ 4 * Vector3::Dot(v, normal) * Vector3::Dot(l, normal) }; // helper variable for ColorRGB/float
-			const ColorRGB specular{ (D * F * G) * (1 / c) };
-			const ColorRGB kd { (m_Metalness) ? ColorRGB(0, 0, 0) : ColorRGB(1, 1, 1) - F };
-			const ColorRGB diffuse{ BRDF::Lambert(m_Albedo, kd) };
-
-			return diffuse + specular;
+			MaterialData data{};
+			data.type = MaterialType::CookTorrence;
+			data.isMetal = m_Metalness;
+			data.f0 = m_Metalness ? m_Albedo : ColorRGB(0.04f, 0.04f, 0.04f);
+			data.diffuse = BRDF::Lambert(1.f, m_Albedo);
+			data.alphaSquared = Square(Square(m_Roughness));
+			data.k = Square(Square(m_Roughness) + 1) / 8;
+			return data;
 		}
 
 	private:
@@ -0,0 +1,81 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+#include "Math.h"
+#include "BRDFs.h"
+
+namespace dae
+{
+	enum class MaterialType : uint8_t
+	{
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
+	};
+
+	//Flat, type-tagged material as the renderer shades it, baked from a Material when the scene is committed
+	//Everything that does not depend on the light and view directions is precomputed, Shade only evaluates what is left
+	struct MaterialData
+	{
+		ColorRGB diffuse{}; //SolidColor: the color, Lambert(Phong): the Lambert term, CookTorrence: albedo / PI
+		ColorRGB f0{}; //CookTorrence base reflectivity
+		float specularReflectance{}; //Phong ks
+		float phongExponent{};
+		float alphaSquared{}; //CookTorrence roughness^4, the GGX alpha squared
+		float k{}; //Smith Schlick-GGX remapping of the roughness
+		MaterialType type{ MaterialType::SolidColor };
+		bool isMetal{};
+
+		/**
+		 * \brief Evaluates the BRDF
+		 * \param normal surface normal
+		 * \param l light direction
+		 * \param v view direction
+		 * \return color
+		 */
+		ColorRGB Shade(const Vector3& normal, const Vector3& l, const Vector3& v) const
+		{
+			switch (type)
+			{
+			case MaterialType::Lambert:
+				return diffuse;
+			case MaterialType::LambertPhong:
+				return diffuse + BRDF::Phong(specularReflectance, phongExponent, l, -v, normal);
+			case MaterialType::CookTorrence:
+				return ShadeCookTorrence(normal, l, v);
+			default:
+				return diffuse;
+			}
+		}
+
+	private:
+		ColorRGB ShadeCookTorrence(const Vector3& normal, const Vector3& l, const Vector3& v) const
+		{
+			const Vector3 halfVector{ (v + l).Normalized() };
+			const float dotNV{ Vector3::Dot(normal, v) };
+			const float dotNL{ Vector3::Dot(normal, l) };
+			const float dotNH{ Vector3::Dot(normal, halfVector) };
+
+			//Schlick Fresnel with the fifth power multiplied out
+			const float oneMinusCos{ 1.f - Vector3::Dot(halfVector, v) };
+			const float oneMinusCos2{ oneMinusCos * oneMinusCos };
+			const float fresnelWeight{ oneMinusCos2 * oneMinusCos2 * oneMinusCos };
+			const ColorRGB F{ f0 + (ColorRGB{ 1.f, 1.f, 1.f } - f0) * fresnelWeight };
+
+			//GGX
+			const float c{ dotNH * dotNH * (alphaSquared - 1.f) + 1.f };
+			const float D{ alphaSquared / (PI * c * c) };
+
+			//Smith G divided by the 4 * (n.v) * (n.l) of the microfacet denominator, the dot products in the numerator of G cancel out
+			const float visibility{ 1.f / (4.f * (dotNV * (1.f - k) + k) * (dotNL * (1.f - k) + k)) };
+
+			const ColorRGB specular{ F * (D * visibility) };
+			if (isMetal)
+				return specular;
+
+			return diffuse * (ColorRGB{ 1.f, 1.f, 1.f } - F) + specular;
+		}
+	};
+}
@@ -1,53 +1,328 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <xmmintrin.h>
+
 #include "Vector3.h"
 #include "Vector4.h"
 
 namespace dae {
+	//Row-major affine transform, vectors are rows multiplied from the left (v * M), the translation is the last row
+	//Rows are aligned Vector4s, transforms and products run on whole rows in SSE
 	struct Matrix
 	{
-		Matrix() = default;
-		Matrix(
+		constexpr Matrix() = default;
+		constexpr Matrix(
 			const Vector3& xAxis,
 			const Vector3& yAxis,
 			const Vector3& zAxis,
-			const Vector3& t);
+			const Vector3& t) :
+			Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
+		{
+		}
 
-		Matrix(
+		constexpr Matrix(
 			const Vector4& xAxis,
 			const Vector4& yAxis,
 			const Vector4& zAxis,
-			const Vector4& t);
-
-		Matrix(const Matrix& m);
-
-		Vector3 TransformVector(const Vector3& v) const;
-		Vector3 TransformVector(float x, float y, float z) const;
-		Vector3 TransformPoint(const Vector3& p) const;
-		Vector3 TransformPoint(float x, float y, float z) const;
-		const Matrix& Transpose();
-
-		Vector3 GetAxisX() const;
-		Vector3 GetAxisY() const;
-		Vector3 GetAxisZ() const;
-		Vector3 GetTranslation() const;
-
-		static Matrix CreateTranslation(float x, float y, float z);
-		static Matrix CreateTranslation(const Vector3& t);
-		static Matrix CreateRotationX(float pitch);
-		static Matrix CreateRotationY(float yaw);
-		static Matrix CreateRotationZ(float roll);
-		static Matrix CreateRotation(float pitch, float yaw, float roll);
-		static Matrix CreateRotation(const Vector3& r);
-		static Matrix CreateScale(float sx, float sy, float sz);
-		static Matrix CreateScale(const Vector3& s);
-		static Matrix Transpose(const Matrix& m);
-
-		Vector4& operator[](int index);
-		Vector4 operator[](int index) const;
-		Matrix operator*(const Matrix& m) const;
-		const Matrix& operator*=(const Matrix& m);
+			const Vector4& t) :
+			data{ xAxis, yAxis, zAxis, t }
+		{
+		}
+
+		constexpr Matrix(const Matrix& m) = default;
+		constexpr Matrix& operator=(const Matrix& m) = default;
+
+		Vector3 TransformVector(const Vector3& v) const
+		{
+			return TransformVector(v.x, v.y, v.z);
+		}
+
+		Vector3 TransformVector(float x, float y, float z) const
+		{
+			const __m128 result{ _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(data[0].Load(), _mm_set1_ps(x)),
+				_mm_mul_ps(data[1].Load(), _mm_set1_ps(y))),
+				_mm_mul_ps(data[2].Load(), _mm_set1_ps(z))) };
+			return Vector4::Store(result);
+		}
+
+		Vector3 TransformPoint(const Vector3& p) const
+		{
+			return TransformPoint(p.x, p.y, p.z);
+		}
+
+		Vector3 TransformPoint(float x, float y, float z) const
+		{
+			const __m128 result{ _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(data[0].Load(), _mm_set1_ps(x)),
+				_mm_mul_ps(data[1].Load(), _mm_set1_ps(y))),
+				_mm_mul_ps(data[2].Load(), _mm_set1_ps(z))),
+				data[3].Load()) };
+			return Vector4::Store(result);
+		}
+
+		/**
+		 * \brief Transforms an array of points, 4 at a time in SSE
+		 * \param pPoints points to transform
+		 * \param pResult receives the transformed points, may be the same array as pPoints
+		 * \param count number of points
+		 */
+		void TransformPoints(const Vector3* pPoints, Vector3* pResult, size_t count) const
+		{
+			TransformBatch<true, false>(pPoints, pResult, count);
+		}
+
+		/**
+		 * \brief Transforms an array of normals as vectors and normalizes them, 4 at a time in SSE
+		 * \param pNormals normals to transform, call this on the inverse-transpose so non-uniform scales keep them perpendicular
+		 * \param pResult receives the transformed normals, may be the same array as pNormals
+		 * \param count number of normals
+		 */
+		void TransformNormals(const Vector3* pNormals, Vector3* pResult, size_t count) const
+		{
+			TransformBatch<false, true>(pNormals, pResult, count);
+		}
+
+		const Matrix& Transpose()
+		{
+			__m128 row0{ data[0].Load() };
+			__m128 row1{ data[1].Load() };
+			__m128 row2{ data[2].Load() };
+			__m128 row3{ data[3].Load() };
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+			data[0] = Vector4::Store(row0);
+			data[1] = Vector4::Store(row1);
+			data[2] = Vector4::Store(row2);
+			data[3] = Vector4::Store(row3);
+
+			return *this;
+		}
+
+		constexpr Vector3 GetAxisX() const
+		{
+			return data[0];
+		}
+
+		constexpr Vector3 GetAxisY() const
+		{
+			return data[1];
+		}
+
+		constexpr Vector3 GetAxisZ() const
+		{
+			return data[2];
+		}
+
+		constexpr Vector3 GetTranslation() const
+		{
+			return data[3];
+		}
+
+		static constexpr Matrix CreateTranslation(float x, float y, float z)
+		{
+			return CreateTranslation(Vector3{ x, y, z });
+		}
+
+		static constexpr Matrix CreateTranslation(const Vector3& t)
+		{
+			return { Vector3::UnitX, Vector3::UnitY, Vector3::UnitZ, t };
+		}
+
+		static Matrix CreateRotationX(float pitch)
+		{
+			const float c{ cos(pitch)};
+			const float s{ sin(pitch)};
+
+			return Matrix(
+				Vector4{ 1.f, 0.f, 0.f, 0.f },
+				Vector4{ 0.f, c, -s, 0.f },
+				Vector4{ 0.f, s, c, 0.f },
+				Vector4{ 0.f, 0.f, 0.f , 1.f }
+			);
+		}
+
+		static Matrix CreateRotationY(float yaw)
+		{
+			const float c{ cos(yaw) };
+			const float s{ sin(yaw) };
+
+			return Matrix(
+				Vector4{ c, 0.f, s, 0.f },
+				Vector4{ 0.f, 1.f, 0.f, 0.f },
+				Vector4{ -s, 0, c, 0.f },
+				Vector4{ 0.f, 0.f, 0.f, 1.f }
+			);
+		}
+
+		static Matrix CreateRotationZ(float roll)
+		{
+			const float c{ cos(roll) };
+			const float s{ sin(roll) };
+
+			return Matrix(
+				Vector4{ c, -s, 0.f, 0.f },
+				Vector4{ s, c, 0.f, 0.f },
+				Vector4{ 0.f, 0.f, 1.f, 0.f },
+				Vector4{ 0.f, 0.f, 0.f, 1.f }
+			);
+		}
+
+		static Matrix CreateRotation(float pitch, float yaw, float roll)
+		{
+			return CreateRotation({ pitch, yaw, roll });
+		}
+
+		static Matrix CreateRotation(const Vector3& r)
+		{
+			const Matrix x{ CreateRotationX(r.x) };
+			const Matrix y{ CreateRotationY(r.y) };
+			const Matrix z{ CreateRotationZ(r.z) };
+
+			return  x * y * z;
+		}
+
+		static constexpr Matrix CreateScale(float sx, float sy, float sz)
+		{
+			return Matrix(
+				Vector4{ sx, 0.f, 0.f, 0.f },
+				Vector4{ 0.f, sy, 0.f, 0.f },
+				Vector4{ 0.f, 0.f,sz, 0.f},
+				Vector4{ 0.f, 0.f, 0.f, 1.f }
+			);
+		}
+
+		static constexpr Matrix CreateScale(const Vector3& s)
+		{
+			return CreateScale(s.x, s.y, s.z);
+		}
+
+		static Matrix Transpose(const Matrix& m)
+		{
+			Matrix out{ m };
+			out.Transpose();
+
+			return out;
+		}
+
+		/**
+		 * \brief Inverse of a matrix whose last column is (0, 0, 0, 1), which holds for every combination of translations, rotations and scales
+		 * \return inverse of the 3x3 part with the translation taken back through it
+		 */
+		static Matrix InverseAffine(const Matrix& m)
+		{
+			const Vector3 axisX{ m.data[0] };
+			const Vector3 axisY{ m.data[1] };
+			const Vector3 axisZ{ m.data[2] };
+
+			//The columns of the inverse are the cross products of the rows divided by the determinant
+			const Vector3 yz{ Vector3::Cross(axisY, axisZ) };
+			const Vector3 zx{ Vector3::Cross(axisZ, axisX) };
+			const Vector3 xy{ Vector3::Cross(axisX, axisY) };
+			const float invDeterminant{ 1.f / Vector3::Dot(axisX, yz) };
+
+			Matrix inverse{
+				Vector4{ yz * invDeterminant, 0.f },
+				Vector4{ zx * invDeterminant, 0.f },
+				Vector4{ xy * invDeterminant, 0.f },
+				Vector4{ 0.f, 0.f, 0.f, 0.f } };
+			inverse.Transpose();
+
+			const Vector3 translation{ -inverse.TransformVector(m.GetTranslation()) };
+			inverse.data[3] = Vector4{ translation, 1.f };
+			return inverse;
+		}
+
+#pragma region Operator Overloads
+		constexpr Vector4& operator[](int index)
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		constexpr Vector4 operator[](int index) const
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		Matrix operator*(const Matrix& m) const
+		{
+			//Row r of the product is row r of this matrix transforming the rows of m
+			Matrix result{};
+			const __m128 rows[4]{ m.data[0].Load(), m.data[1].Load(), m.data[2].Load(), m.data[3].Load() };
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				const __m128 row{ _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(data[r].x), rows[0]), _mm_mul_ps(_mm_set1_ps(data[r].y), rows[1])),
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(data[r].z), rows[2]), _mm_mul_ps(_mm_set1_ps(data[r].w), rows[3]))) };
+				result.data[r] = Vector4::Store(row);
+			}
+
+			return result;
+		}
+
+		const Matrix& operator*=(const Matrix& m)
+		{
+			*this = *this * m;
+			return *this;
+		}
+#pragma endregion
 
 	private:
+		template<bool isPoint, bool normalize>
+		void TransformBatch(const Vector3* pInput, Vector3* pOutput, size_t count) const
+		{
+			const __m128 m00{ _mm_set1_ps(data[0].x) }, m01{ _mm_set1_ps(data[0].y) }, m02{ _mm_set1_ps(data[0].z) };
+			const __m128 m10{ _mm_set1_ps(data[1].x) }, m11{ _mm_set1_ps(data[1].y) }, m12{ _mm_set1_ps(data[1].z) };
+			const __m128 m20{ _mm_set1_ps(data[2].x) }, m21{ _mm_set1_ps(data[2].y) }, m22{ _mm_set1_ps(data[2].z) };
+			const __m128 m30{ _mm_set1_ps(data[3].x) }, m31{ _mm_set1_ps(data[3].y) }, m32{ _mm_set1_ps(data[3].z) };
+
+			//4 Vector3s are 3 registers: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3, they are shuffled into x, y and z registers and back
+			size_t i{ 0 };
+			for (; i + 4 <= count; i += 4)
+			{
+				const float* pIn{ &pInput[i].x };
+				const __m128 a{ _mm_loadu_ps(pIn) };
+				const __m128 b{ _mm_loadu_ps(pIn + 4) };
+				const __m128 c{ _mm_loadu_ps(pIn + 8) };
+
+				const __m128 x{ _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)) };
+				const __m128 y{ _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)) };
+				const __m128 z{ _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)) };
+
+				__m128 outX{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m10)), _mm_mul_ps(z, m20)) };
+				__m128 outY{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m01), _mm_mul_ps(y, m11)), _mm_mul_ps(z, m21)) };
+				__m128 outZ{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m02), _mm_mul_ps(y, m12)), _mm_mul_ps(z, m22)) };
+				if constexpr (isPoint)
+				{
+					outX = _mm_add_ps(outX, m30);
+					outY = _mm_add_ps(outY, m31);
+					outZ = _mm_add_ps(outZ, m32);
+				}
+				if constexpr (normalize)
+				{
+					const __m128 sqrMagnitude{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(outX, outX), _mm_mul_ps(outY, outY)), _mm_mul_ps(outZ, outZ)) };
+					const __m128 invMagnitude{ _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(sqrMagnitude)) };
+					outX = _mm_mul_ps(outX, invMagnitude);
+					outY = _mm_mul_ps(outY, invMagnitude);
+					outZ = _mm_mul_ps(outZ, invMagnitude);
+				}
+
+				float* pOut{ &pOutput[i].x };
+				_mm_storeu_ps(pOut, _mm_shuffle_ps(_mm_shuffle_ps(outX, outY, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(outZ, outX, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+				_mm_storeu_ps(pOut + 4, _mm_shuffle_ps(_mm_shuffle_ps(outY, outZ, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(outX, outY, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+				_mm_storeu_ps(pOut + 8, _mm_shuffle_ps(_mm_shuffle_ps(outZ, outX, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(outY, outZ, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+			}
+
+			for (; i < count; ++i)
+			{
+				const Vector3 v{ isPoint ? TransformPoint(pInput[i]) : TransformVector(pInput[i]) };
+				pOutput[i] = normalize ? v.Normalized() : v;
+			}
+		}
 
 		//Row-Major Matrix
 		Vector4 data[4]
@@ -63,4 +338,4 @@ namespace dae {
 		// v2x v2y v2z v2w
 		// v3x v3y v3z v3w
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,162 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include "DataTypes.h"
+#include "MappedFile.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Bump whenever the layout of the file or of a stored type changes, caches of older versions are then rebuilt
+		constexpr uint32_t CacheVersion{ 1 };
+		constexpr char CacheMagic[4]{ 'D', 'A', 'E', 'M' };
+
+		//Followed by the positions, normals, indices, BVH nodes and BVH primitive indices, in that order and without padding
+		struct CacheHeader
+		{
+			char magic[4]{};
+			uint32_t version{};
+			uint64_t assetHash{};
+			uint64_t assetSize{};
+			uint32_t numPositions{};
+			uint32_t numTriangles{};
+			uint32_t numNodes{};
+			uint32_t numPrimitiveIndices{};
+		};
+
+		//Every section is read straight from the mapping, which only guarantees the 4-byte alignment of the sections after the header
+		static_assert(sizeof(CacheHeader) % 4 == 0);
+		static_assert(std::is_trivially_copyable_v<Vector3> && alignof(Vector3) <= 4);
+		static_assert(std::is_trivially_copyable_v<BVHNode> && alignof(BVHNode) <= 4);
+
+		size_t GetCacheSize(const CacheHeader& header)
+		{
+			return sizeof(CacheHeader)
+				+ static_cast<size_t>(header.numPositions) * sizeof(Vector3)
+				+ static_cast<size_t>(header.numTriangles) * (sizeof(Vector3) + 3 * sizeof(int))
+				+ static_cast<size_t>(header.numNodes) * sizeof(BVHNode)
+				+ static_cast<size_t>(header.numPrimitiveIndices) * sizeof(uint32_t);
+		}
+
+		//Detects edits to an asset, not tampering, so a fast multiply-rotate over 8-byte words is enough
+		uint64_t HashContents(const char* pData, size_t size)
+		{
+			constexpr uint64_t multiplier{ 0x9E3779B97F4A7C15 };
+			uint64_t hash{ size };
+
+			size_t i{ 0 };
+			for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+			{
+				uint64_t word{};
+				std::memcpy(&word, pData + i, sizeof(uint64_t));
+				hash = std::rotl((hash ^ word) * multiplier, 31);
+			}
+			for (; i < size; ++i)
+			{
+				hash = std::rotl((hash ^ static_cast<uint8_t>(pData[i])) * multiplier, 31);
+			}
+			return hash;
+		}
+
+		template<typename T>
+		const T* ReadSection(const char*& pSection, size_t count)
+		{
+			const T* pData{ reinterpret_cast<const T*>(pSection) };
+			pSection += count * sizeof(T);
+			return pData;
+		}
+
+		template<typename T>
+		void WriteSection(std::ofstream& file, const std::vector<T>& data)
+		{
+			file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(T)));
+		}
+	}
+
+	std::string MeshCache::GetCachePath(const std::string& assetPath)
+	{
+		return assetPath + ".meshcache";
+	}
+
+	bool MeshCache::Load(const std::string& assetPath, TriangleMesh& mesh)
+	{
+		const MappedFile cache{ GetCachePath(assetPath) };
+		if (!cache.IsOpen() || cache.GetSize() < sizeof(CacheHeader))
+			return false;
+
+		CacheHeader header{};
+		std::memcpy(&header, cache.GetData(), sizeof(CacheHeader));
+		if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != CacheVersion
+			|| cache.GetSize() != GetCacheSize(header) || header.numPrimitiveIndices != header.numTriangles)
+			return false;
+
+		const MappedFile asset{ assetPath };
+		if (!asset.IsOpen() || asset.GetSize() != header.assetSize || HashContents(asset.GetData(), asset.GetSize()) != header.assetHash)
+			return false;
+
+		const char* pSection{ cache.GetData() + sizeof(CacheHeader) };
+		const Vector3* pPositions{ ReadSection<Vector3>(pSection, header.numPositions) };
+		const Vector3* pNormals{ ReadSection<Vector3>(pSection, header.numTriangles) };
+		const int* pIndices{ ReadSection<int>(pSection, static_cast<size_t>(header.numTriangles) * 3) };
+		const BVHNode* pNodes{ ReadSection<BVHNode>(pSection, header.numNodes) };
+		const uint32_t* pPrimitiveIndices{ ReadSection<uint32_t>(pSection, header.numPrimitiveIndices) };
+
+		//The hash only proves the asset is unchanged, the cache itself could still be damaged
+		const int* pIndicesEnd{ pIndices + static_cast<size_t>(header.numTriangles) * 3 };
+		const uint32_t numPositions{ header.numPositions };
+		if (!std::all_of(pIndices, pIndicesEnd, [numPositions](int index) { return index >= 0 && static_cast<uint32_t>(index) < numPositions; }))
+			return false;
+
+		BVH bvh{};
+		if (!bvh.Restore(pNodes, header.numNodes, pPrimitiveIndices, header.numPrimitiveIndices))
+			return false;
+
+		mesh.positions.assign(pPositions, pPositions + header.numPositions);
+		mesh.normals.assign(pNormals, pNormals + header.numTriangles);
+		mesh.indices.assign(pIndices, pIndicesEnd);
+		mesh.bvh = std::move(bvh);
+		return true;
+	}
+
+	bool MeshCache::Save(const std::string& assetPath, const TriangleMesh& mesh)
+	{
+		const uint32_t numTriangles{ static_cast<uint32_t>(mesh.indices.size() / 3) };
+		if (mesh.normals.size() != numTriangles || mesh.bvh.GetPrimitiveCount() != numTriangles)
+			return false;
+
+		const MappedFile asset{ assetPath };
+		if (!asset.IsOpen())
+			return false;
+
+		CacheHeader header{};
+		std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+		header.version = CacheVersion;
+		header.assetHash = HashContents(asset.GetData(), asset.GetSize());
+		header.assetSize = asset.GetSize();
+		header.numPositions = static_cast<uint32_t>(mesh.positions.size());
+		header.numTriangles = numTriangles;
+		header.numNodes = static_cast<uint32_t>(mesh.bvh.GetNodes().size());
+		header.numPrimitiveIndices = mesh.bvh.GetPrimitiveCount();
+
+		std::ofstream file{ GetCachePath(assetPath), std::ios::binary | std::ios::trunc };
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+		WriteSection(file, mesh.positions);
+		WriteSection(file, mesh.normals);
+		WriteSection(file, mesh.indices);
+		WriteSection(file, mesh.bvh.GetNodes());
+		WriteSection(file, mesh.bvh.GetPrimitiveIndices());
+
+		//A cache cut short by a failed write has the wrong size, Load rejects it
+		return static_cast<bool>(file);
+	}
+}
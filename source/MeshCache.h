@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+
+namespace dae
+{
+	struct TriangleMesh;
+
+	//Binary copy of a mesh loaded from an asset, stored next to it as <asset>.meshcache
+	//Holds the positions, normals, indices and the BVH in the layout the mesh keeps them in memory, so loading it is a few copies
+	//A cache only matches the exact asset bytes it was written from, editing the asset invalidates it
+	namespace MeshCache
+	{
+		std::string GetCachePath(const std::string& assetPath);
+
+		/**
+		 * \brief Fills the mesh from the cache of an asset
+		 * \param assetPath path of the source asset, its contents are hashed and compared with the hash in the cache
+		 * \param mesh receives the positions, normals, indices and BVH, the transformed data still needs an UpdateTransforms
+		 * \return false when there is no cache, it is from another version or asset, or it is damaged, the mesh is not touched then
+		 */
+		bool Load(const std::string& assetPath, TriangleMesh& mesh);
+
+		/**
+		 * \brief Writes the cache of an asset
+		 * \param assetPath path of the source asset the mesh was loaded from
+		 * \param mesh freshly loaded mesh, its BVH has to be built with an identity transform so it matches the positions
+		 * \return false when the asset or the cache file cannot be accessed
+		 */
+		bool Save(const std::string& assetPath, const TriangleMesh& mesh);
+	}
+}
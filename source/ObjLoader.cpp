@@ -0,0 +1,321 @@
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Bytes per parse job, the end of a chunk is moved to the next line break so no line is split between two jobs
+		constexpr size_t ChunkSize{ 1 << 20 };
+		constexpr uint32_t NormalBatchSize{ 4096 };
+
+		//Part of the file that starts and ends on a line boundary
+		struct Chunk
+		{
+			const char* pBegin{ nullptr };
+			const char* pEnd{ nullptr };
+
+			//Filled by the counting pass
+			uint32_t numPositions{ 0 };
+			uint32_t numTriangles{ 0 };
+
+			//Sums of the counts of all chunks before this one, where the parsing pass writes its output
+			uint32_t firstPosition{ 0 };
+			uint32_t firstTriangle{ 0 };
+
+			bool isValid{ true };
+		};
+
+		enum class Command
+		{
+			Other,
+			Vertex,
+			Face
+		};
+
+		bool IsSpace(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\r';
+		}
+
+		const char* SkipSpaces(const char* p, const char* pLineEnd)
+		{
+			while (p < pLineEnd && IsSpace(*p))
+				++p;
+			return p;
+		}
+
+		const char* SkipToken(const char* p, const char* pLineEnd)
+		{
+			while (p < pLineEnd && !IsSpace(*p))
+				++p;
+			return p;
+		}
+
+		const char* FindLineEnd(const char* p, const char* pEnd)
+		{
+			const void* pLineBreak{ std::memchr(p, '\n', pEnd - p) };
+			return pLineBreak ? static_cast<const char*>(pLineBreak) : pEnd;
+		}
+
+		//End of the part of a line in front of a # comment
+		const char* FindContentEnd(const char* pLine, const char* pLineEnd)
+		{
+			const void* pComment{ std::memchr(pLine, '#', pLineEnd - pLine) };
+			return pComment ? static_cast<const char*>(pComment) : pLineEnd;
+		}
+
+		//Only v and f lines build the mesh, vt, vn, comments, groups and materials are skipped
+		Command ReadCommand(const char*& p, const char* pLineEnd)
+		{
+			p = SkipSpaces(p, pLineEnd);
+			if (pLineEnd - p < 2 || !IsSpace(p[1]))
+				return Command::Other;
+
+			const char command{ *p };
+			p += 2;
+			if (command == 'v')
+				return Command::Vertex;
+			if (command == 'f')
+				return Command::Face;
+			return Command::Other;
+		}
+
+		bool ParseFloat(const char*& p, const char* pLineEnd, float& value)
+		{
+			p = SkipSpaces(p, pLineEnd);
+
+			//from_chars does not accept an explicit plus sign
+			if (p < pLineEnd && *p == '+')
+				++p;
+
+			const auto [pNext, error] { std::from_chars(p, pLineEnd, value) };
+			p = pNext;
+			return error == std::errc{};
+		}
+
+		//Corners are v, v/vt, v//vn or v/vt/vn, only the position index is kept
+		bool ParseCorner(const char*& p, const char* pLineEnd, int& positionIndex)
+		{
+			const auto [pNext, error] { std::from_chars(p, pLineEnd, positionIndex) };
+			if (error != std::errc{})
+				return false;
+			p = pNext;
+
+			for (int attribute{ 0 }; attribute < 2 && p < pLineEnd && *p == '/'; ++attribute)
+			{
+				++p;
+
+				//The texture coordinate index is empty in v//vn
+				int attributeIndex{};
+				const auto [pAfterIndex, attributeError] { std::from_chars(p, pLineEnd, attributeIndex) };
+				if (attributeError == std::errc{})
+					p = pAfterIndex;
+			}
+
+			return p == pLineEnd || IsSpace(*p);
+		}
+
+		void CountChunk(Chunk& chunk)
+		{
+			for (const char* pLine{ chunk.pBegin }; pLine < chunk.pEnd;)
+			{
+				const char* pLineEnd{ FindLineEnd(pLine, chunk.pEnd) };
+				const char* pContentEnd{ FindContentEnd(pLine, pLineEnd) };
+
+				const char* p{ pLine };
+				switch (ReadCommand(p, pContentEnd))
+				{
+				case Command::Vertex:
+					++chunk.numPositions;
+					break;
+				case Command::Face:
+				{
+					uint32_t numCorners{ 0 };
+					for (p = SkipSpaces(p, pContentEnd); p < pContentEnd; p = SkipSpaces(SkipToken(p, pContentEnd), pContentEnd))
+						++numCorners;
+
+					if (numCorners >= 3)
+						chunk.numTriangles += numCorners - 2;
+					break;
+				}
+				default:
+					break;
+				}
+
+				pLine = pLineEnd + 1;
+			}
+		}
+
+		void ParseChunk(Chunk& chunk, uint32_t totalPositions, int indexOffset, Vector3* pPositions, int* pIndices)
+		{
+			uint32_t positionIndex{ chunk.firstPosition };
+			int* pTriangle{ pIndices + static_cast<size_t>(chunk.firstTriangle) * 3 };
+
+			for (const char* pLine{ chunk.pBegin }; pLine < chunk.pEnd && chunk.isValid;)
+			{
+				const char* pLineEnd{ FindLineEnd(pLine, chunk.pEnd) };
+				const char* pContentEnd{ FindContentEnd(pLine, pLineEnd) };
+
+				const char* p{ pLine };
+				switch (ReadCommand(p, pContentEnd))
+				{
+				case Command::Vertex:
+				{
+					Vector3& position{ pPositions[positionIndex++] };
+					chunk.isValid = ParseFloat(p, pContentEnd, position.x) && ParseFloat(p, pContentEnd, position.y) && ParseFloat(p, pContentEnd, position.z);
+					break;
+				}
+				case Command::Face:
+				{
+					//Polygons become a fan around their first corner
+					int firstCorner{};
+					int previousCorner{};
+					uint32_t numCorners{ 0 };
+					for (p = SkipSpaces(p, pContentEnd); p < pContentEnd && chunk.isValid; p = SkipSpaces(p, pContentEnd))
+					{
+						int index{};
+						if (!ParseCorner(p, pContentEnd, index) || index == 0)
+						{
+							chunk.isValid = false;
+							break;
+						}
+
+						//Indices start at 1, negative ones count back from the last position defined before the face
+						const int64_t resolvedIndex{ index > 0 ? index - 1 : static_cast<int64_t>(positionIndex) + index };
+						if (resolvedIndex < 0 || resolvedIndex >= totalPositions)
+						{
+							chunk.isValid = false;
+							break;
+						}
+
+						const int corner{ static_cast<int>(resolvedIndex) + indexOffset };
+						if (numCorners == 0)
+						{
+							firstCorner = corner;
+						}
+						else if (numCorners >= 2)
+						{
+							pTriangle[0] = firstCorner;
+							pTriangle[1] = previousCorner;
+							pTriangle[2] = corner;
+							pTriangle += 3;
+						}
+
+						previousCorner = corner;
+						++numCorners;
+					}
+
+					//Lines with fewer than 3 corners did not count any triangles, skipping them keeps the output in step with the counts
+					break;
+				}
+				default:
+					break;
+				}
+
+				pLine = pLineEnd + 1;
+			}
+		}
+
+		void RunParallel(ThreadPool* pThreadPool, uint32_t count, const std::function<void(uint32_t)>& task)
+		{
+			if (pThreadPool)
+			{
+				pThreadPool->ParallelFor(count, task);
+				return;
+			}
+
+			for (uint32_t i{ 0 }; i < count; ++i)
+			{
+				task(i);
+			}
+		}
+	}
+
+	bool ObjLoader::Load(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices,
+		ThreadPool* pThreadPool)
+	{
+		const MappedFile file{ filename };
+		if (!file.IsOpen())
+			return false;
+
+		std::vector<Chunk> chunks{};
+		const char* pFileEnd{ file.GetData() + file.GetSize() };
+		for (const char* pChunkBegin{ file.GetData() }; pChunkBegin < pFileEnd;)
+		{
+			const char* pChunkEnd{ pChunkBegin + std::min(ChunkSize, static_cast<size_t>(pFileEnd - pChunkBegin)) };
+			if (pChunkEnd < pFileEnd)
+				pChunkEnd = std::min(FindLineEnd(pChunkEnd - 1, pFileEnd) + 1, pFileEnd);
+
+			Chunk& chunk{ chunks.emplace_back() };
+			chunk.pBegin = pChunkBegin;
+			chunk.pEnd = pChunkEnd;
+			pChunkBegin = pChunkEnd;
+		}
+
+		//First pass only counts, so every output buffer is allocated once at its final size and every chunk knows where to write
+		const uint32_t numChunks{ static_cast<uint32_t>(chunks.size()) };
+		RunParallel(pThreadPool, numChunks, [&chunks](uint32_t chunkIndex) { CountChunk(chunks[chunkIndex]); });
+
+		uint32_t totalPositions{ 0 };
+		uint32_t totalTriangles{ 0 };
+		for (Chunk& chunk : chunks)
+		{
+			chunk.firstPosition = totalPositions;
+			chunk.firstTriangle = totalTriangles;
+			totalPositions += chunk.numPositions;
+			totalTriangles += chunk.numTriangles;
+		}
+
+		const size_t oldNumPositions{ positions.size() };
+		const size_t oldNumNormals{ normals.size() };
+		const size_t oldNumIndices{ indices.size() };
+		positions.resize(oldNumPositions + totalPositions);
+		normals.resize(oldNumNormals + totalTriangles);
+		indices.resize(oldNumIndices + static_cast<size_t>(totalTriangles) * 3);
+
+		Vector3* pPositions{ positions.data() + oldNumPositions };
+		Vector3* pNormals{ normals.data() + oldNumNormals };
+		int* pIndices{ indices.data() + oldNumIndices };
+		const int indexOffset{ static_cast<int>(oldNumPositions) };
+
+		RunParallel(pThreadPool, numChunks, [&](uint32_t chunkIndex)
+			{
+				ParseChunk(chunks[chunkIndex], totalPositions, indexOffset, pPositions, pIndices);
+			});
+
+		const bool isValid{ std::all_of(chunks.begin(), chunks.end(), [](const Chunk& chunk) { return chunk.isValid; }) };
+		if (!isValid)
+		{
+			positions.resize(oldNumPositions);
+			normals.resize(oldNumNormals);
+			indices.resize(oldNumIndices);
+			return false;
+		}
+
+		//Faces can reference positions of any chunk, so the normals wait until all of them are parsed
+		const Vector3* pAllPositions{ positions.data() };
+		const uint32_t numNormalBatches{ (totalTriangles + NormalBatchSize - 1) / NormalBatchSize };
+		RunParallel(pThreadPool, numNormalBatches, [&](uint32_t batchIndex)
+			{
+				const uint32_t end{ std::min((batchIndex + 1) * NormalBatchSize, totalTriangles) };
+				for (uint32_t i{ batchIndex * NormalBatchSize }; i < end; ++i)
+				{
+					const Vector3& v0{ pAllPositions[pIndices[i * 3]] };
+					const Vector3 edgeV0V1{ pAllPositions[pIndices[i * 3 + 1]] - v0 };
+					const Vector3 edgeV0V2{ pAllPositions[pIndices[i * 3 + 2]] - v0 };
+					pNormals[i] = Vector3::Cross(edgeV0V1, edgeV0V2).Normalized();
+				}
+			});
+
+		return true;
+	}
+}
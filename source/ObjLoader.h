@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	class ThreadPool;
+
+	namespace ObjLoader
+	{
+		/**
+		 * \brief Loads the triangles of an OBJ file, polygons are split into triangle fans
+		 * \param filename path to the OBJ file, it is memory-mapped and parsed in chunks
+		 * \param positions the v positions are appended to it
+		 * \param normals one geometric normal per triangle is appended to it
+		 * \param indices 3 zero-based indices into positions per triangle are appended to it
+		 * \param pThreadPool parses the chunks in parallel, nullptr parses them on the calling thread
+		 * \return false when the file cannot be read or is malformed, the output vectors are left untouched then
+		 */
+		bool Load(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices,
+			ThreadPool* pThreadPool = nullptr);
+	}
+}
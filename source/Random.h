@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+
+namespace dae
+{
+	//PCG32 (XSH RR variant), small state and statistically far better than rand()
+	//Every pixel seeds its own generator, so the output does not depend on which thread renders it
+	class PCG32 final
+	{
+	public:
+		/**
+		 * \param seed initial state
+		 * \param sequence selects one of 2^63 independent streams
+		 */
+		explicit PCG32(uint64_t seed, uint64_t sequence = 1)
+		{
+			m_Increment = (sequence << 1u) | 1u;
+			NextUInt();
+			m_State += seed;
+			NextUInt();
+		}
+
+		uint32_t NextUInt()
+		{
+			const uint64_t oldState{ m_State };
+			m_State = oldState * 6364136223846793005ull + m_Increment;
+
+			const uint32_t xorShifted{ static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u) };
+			const uint32_t rotation{ static_cast<uint32_t>(oldState >> 59u) };
+			return (xorShifted >> rotation) | (xorShifted << ((~rotation + 1u) & 31u));
+		}
+
+		//Uniform float in [0, 1)
+		float NextFloat()
+		{
+			//The top 24 bits fill the float mantissa exactly, so 1.f can never be returned
+			return static_cast<float>(NextUInt() >> 8) * (1.f / 16777216.f);
+		}
+
+	private:
+		uint64_t m_State{ 0 };
+		uint64_t m_Increment{ 1 };
+	};
+
+	//Mixes two values into a well distributed 64-bit seed (splitmix64 finalizer)
+	inline uint64_t HashSeed(uint64_t a, uint64_t b)
+	{
+		uint64_t x{ a * 0x9E3779B97F4A7C15ull ^ (b + 0x632BE59BD9B4E019ull) };
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	/**
+	 * \brief Van der Corput radical inverse, the building block of the Halton sequence
+	 * \param index sample index
+	 * \param base prime base, a different base per dimension (2, 3, 5, ...)
+	 * \return low-discrepancy value in [0, 1)
+	 */
+	inline float RadicalInverse(uint32_t index, uint32_t base)
+	{
+		const float invBase{ 1.f / base };
+		float invBaseN{ 1.f };
+		uint64_t reversedDigits{ 0 };
+		while (index > 0)
+		{
+			const uint32_t next{ index / base };
+			reversedDigits = reversedDigits * base + (index - next * base);
+			invBaseN *= invBase;
+			index = next;
+		}
+
+		const float result{ reversedDigits * invBaseN };
+		return result < 1.f ? result : 0.99999994f;
+	}
+
+	//Adds a per-pixel random offset and wraps around (Cranley-Patterson rotation), keeps the stratification but hides the shared pattern
+	inline float RotateSample(float sample, float offset)
+	{
+		const float rotated{ sample + offset };
+		return rotated < 1.f ? rotated : rotated - 1.f;
+	}
+
+	/**
+	 * \brief Jittered sample in one cell of a grid covering the unit square, count samples together cover every cell once
+	 * \param index sample index in [0, count)
+	 * \param jitterU, jitterV position inside the cell in [0, 1)
+	 */
+	inline void StratifiedSample(int index, int count, float jitterU, float jitterV, float& u, float& v)
+	{
+		//Most square grid with exactly count cells, so no cell is sampled more often than another
+		int columns{ 1 };
+		for (int divisor = 2; divisor * divisor <= count; ++divisor)
+		{
+			if (count % divisor == 0)
+				columns = divisor;
+		}
+		const int rows{ count / columns };
+
+		//Rounding can push the last cell onto 1
+		u = (index % columns + jitterU) / columns;
+		v = (index / columns + jitterV) / rows;
+		u = u < 1.f ? u : 0.99999994f;
+		v = v < 1.f ? v : 0.99999994f;
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <immintrin.h>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Four coherent rays stored as structure of arrays, one SSE lane per ray
+	//Primary rays of a 2x2 pixel block share the camera origin and have nearly identical directions,
+	//so a single node or primitive test in SSE answers the question for all of them at once
+	struct RayPacket4
+	{
+		static constexpr int Width{ 4 };
+		static constexpr int FullMask{ (1 << Width) - 1 };
+
+		__m128 originX{};
+		__m128 originY{};
+		__m128 originZ{};
+
+		__m128 directionX{};
+		__m128 directionY{};
+		__m128 directionZ{};
+
+		__m128 invDirectionX{};
+		__m128 invDirectionY{};
+		__m128 invDirectionZ{};
+
+		__m128 min{};
+		__m128 max{};
+
+		//Bit i is set when lane i carries a ray, partial packets at tile borders leave lanes empty
+		int activeMask{ 0 };
+
+		void SetRays(const Ray rays[Width], int laneMask)
+		{
+			alignas(16) float values[11][Width]{};
+			for (int lane{ 0 }; lane < Width; ++lane)
+			{
+				const Ray& ray{ rays[lane] };
+				values[0][lane] = ray.origin.x;
+				values[1][lane] = ray.origin.y;
+				values[2][lane] = ray.origin.z;
+				values[3][lane] = ray.direction.x;
+				values[4][lane] = ray.direction.y;
+				values[5][lane] = ray.direction.z;
+				values[6][lane] = 1.f / ray.direction.x;
+				values[7][lane] = 1.f / ray.direction.y;
+				values[8][lane] = 1.f / ray.direction.z;
+				values[9][lane] = ray.min;
+				//Empty lanes get a negative max, no intersection test can ever accept them
+				values[10][lane] = (laneMask & (1 << lane)) ? ray.max : -1.f;
+			}
+
+			originX = _mm_load_ps(values[0]);
+			originY = _mm_load_ps(values[1]);
+			originZ = _mm_load_ps(values[2]);
+			directionX = _mm_load_ps(values[3]);
+			directionY = _mm_load_ps(values[4]);
+			directionZ = _mm_load_ps(values[5]);
+			invDirectionX = _mm_load_ps(values[6]);
+			invDirectionY = _mm_load_ps(values[7]);
+			invDirectionZ = _mm_load_ps(values[8]);
+			min = _mm_load_ps(values[9]);
+			max = _mm_load_ps(values[10]);
+			activeMask = laneMask;
+		}
+
+		//Extracts a single lane as a scalar ray, used for primitives that have no packet kernel
+		Ray GetRay(int lane) const
+		{
+			alignas(16) float values[8][Width]{};
+			_mm_store_ps(values[0], originX);
+			_mm_store_ps(values[1], originY);
+			_mm_store_ps(values[2], originZ);
+			_mm_store_ps(values[3], directionX);
+			_mm_store_ps(values[4], directionY);
+			_mm_store_ps(values[5], directionZ);
+			_mm_store_ps(values[6], min);
+			_mm_store_ps(values[7], max);
+
+			return Ray{
+				{ values[0][lane], values[1][lane], values[2][lane] },
+				{ values[3][lane], values[4][lane], values[5][lane] },
+				values[6][lane], values[7][lane]
+			};
+		}
+
+		float GetMax(int lane) const
+		{
+			alignas(16) float values[Width]{};
+			_mm_store_ps(values, max);
+			return values[lane];
+		}
+
+		//Shrinks the max of every lane in laneMask to the matching lane of t
+		void SetMax(__m128 t, int laneMask)
+		{
+			max = Select(MaskToVector(laneMask), t, max);
+		}
+
+		static int CountLanes(int laneMask)
+		{
+			return (laneMask & 1) + ((laneMask >> 1) & 1) + ((laneMask >> 2) & 1) + ((laneMask >> 3) & 1);
+		}
+
+		static __m128 Select(__m128 mask, __m128 a, __m128 b)
+		{
+			return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+		}
+
+		static __m128 MaskToVector(int laneMask)
+		{
+			const __m128i laneBits{ _mm_set_epi32(8, 4, 2, 1) };
+			const __m128i bits{ _mm_and_si128(_mm_set1_epi32(laneMask), laneBits) };
+			return _mm_castsi128_ps(_mm_cmpeq_epi32(bits, laneBits));
+		}
+	};
+}
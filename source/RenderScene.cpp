@@ -0,0 +1,457 @@
+#include "RenderScene.h"
+
+#include <algorithm>
+
+#include "Material.h"
+#include "Utils.h"
+
+namespace dae
+{
+	void RenderScene::BuildPlanes(const std::vector<Plane>& planes)
+	{
+		//Normalized once here instead of per ray
+		const size_t numPlanes{ planes.size() };
+		m_Planes.normalX.resize(numPlanes);
+		m_Planes.normalY.resize(numPlanes);
+		m_Planes.normalZ.resize(numPlanes);
+		m_Planes.distance.resize(numPlanes);
+		m_Planes.materialIndex.resize(numPlanes);
+		for (size_t i{ 0 }; i < numPlanes; ++i)
+		{
+			const Vector3 normal{ planes[i].normal.Normalized() };
+			m_Planes.normalX[i] = normal.x;
+			m_Planes.normalY[i] = normal.y;
+			m_Planes.normalZ[i] = normal.z;
+			m_Planes.distance[i] = Vector3::Dot(planes[i].origin, normal);
+			m_Planes.materialIndex[i] = planes[i].materialIndex;
+		}
+	}
+
+	void RenderScene::BuildSpheres(const std::vector<Sphere>& spheres)
+	{
+		//Reordered so every block of SphereKernels::BlockWidth is spatially close, a BVH over the spheres only decides that order
+		//The padding at the end has a negative squared radius so its discriminant is never positive
+		const size_t numSpheres{ spheres.size() };
+		std::vector<AABB> sphereBounds{};
+		sphereBounds.reserve(numSpheres);
+		for (const Sphere& sphere : spheres)
+		{
+			const Vector3 extents{ sphere.radius, sphere.radius, sphere.radius };
+
+			AABB bounds{};
+			bounds.Grow(sphere.origin - extents);
+			bounds.Grow(sphere.origin + extents);
+			sphereBounds.push_back(bounds);
+		}
+
+		BVH sphereOrder{};
+		sphereOrder.Build(sphereBounds);
+		const std::vector<uint32_t>& sortedSpheres{ sphereOrder.GetPrimitiveIndices() };
+
+		const size_t paddedSpheres{ (numSpheres + SphereKernels::BlockWidth - 1) / SphereKernels::BlockWidth * SphereKernels::BlockWidth };
+		m_Spheres.centerX.assign(paddedSpheres, 0.f);
+		m_Spheres.centerY.assign(paddedSpheres, 0.f);
+		m_Spheres.centerZ.assign(paddedSpheres, 0.f);
+		m_Spheres.radiusSquared.assign(paddedSpheres, -FLT_MAX);
+		m_Spheres.invRadius.assign(paddedSpheres, 0.f);
+		m_Spheres.materialIndex.resize(numSpheres);
+		for (size_t i{ 0 }; i < numSpheres; ++i)
+		{
+			const Sphere& sphere{ spheres[sortedSpheres[i]] };
+			m_Spheres.centerX[i] = sphere.origin.x;
+			m_Spheres.centerY[i] = sphere.origin.y;
+			m_Spheres.centerZ[i] = sphere.origin.z;
+			m_Spheres.radiusSquared[i] = sphere.radius * sphere.radius;
+			m_Spheres.invRadius[i] = 1.f / sphere.radius;
+			m_Spheres.materialIndex[i] = sphere.materialIndex;
+		}
+		m_SphereCount = static_cast<uint32_t>(numSpheres);
+
+		m_SphereBlockBounds.clear();
+		for (uint32_t first{ 0 }; first < m_SphereCount; first += SphereKernels::BlockWidth)
+		{
+			AABB bounds{};
+			const uint32_t end{ std::min(first + SphereKernels::BlockWidth, m_SphereCount) };
+			for (uint32_t i{ first }; i < end; ++i)
+				bounds.Grow(sphereBounds[sortedSpheres[i]]);
+
+			m_SphereBlockBounds.push_back(bounds);
+		}
+	}
+
+	void RenderScene::BuildObjects(const std::vector<TriangleMesh>& triangleMeshes, const std::vector<TriangleMeshInstance>& triangleMeshInstances)
+	{
+		m_BoundedObjects.clear();
+		m_BoundedObjectBounds.clear();
+		m_Meshes.clear();
+		m_MeshInstances.clear();
+
+		//Every block of spheres is one leaf object, its hit test runs the widest sphere kernel over the whole block at once
+		for (uint32_t block{ 0 }; block < m_SphereBlockBounds.size(); ++block)
+		{
+			m_BoundedObjects.push_back({ BoundedObjectType::SphereBlock, block * SphereKernels::BlockWidth });
+			m_BoundedObjectBounds.push_back(m_SphereBlockBounds[block]);
+		}
+
+		//Each mesh keeps its own bottom-level BVH up to date in UpdateTransforms, only its bounds are needed here
+		for (const TriangleMesh& mesh : triangleMeshes)
+		{
+			if (mesh.bvh.IsEmpty())
+				continue;
+
+			m_BoundedObjects.push_back({ BoundedObjectType::TriangleMesh, static_cast<uint32_t>(m_Meshes.size()) });
+			m_BoundedObjectBounds.push_back(mesh.bvh.GetBounds());
+			m_Meshes.push_back({ &mesh, mesh.cullMode, mesh.materialIndex });
+		}
+
+		//Instances reference the object-space BVH of a shared mesh, they only contribute their world bounds
+		for (uint32_t i{ 0 }; i < triangleMeshInstances.size(); ++i)
+		{
+			const TriangleMeshInstance& instance{ triangleMeshInstances[i] };
+			if (!instance.pMesh || instance.pMesh->bvh.IsEmpty())
+				continue;
+
+			m_BoundedObjects.push_back({ BoundedObjectType::TriangleMeshInstance, static_cast<uint32_t>(m_MeshInstances.size()) });
+			m_BoundedObjectBounds.push_back(instance.transformedBounds);
+			m_MeshInstances.push_back({ instance.pMesh, i, instance.worldToObject, instance.normalToWorld, instance.cullMode, instance.materialIndex });
+		}
+
+		m_TopLevelBVH.Build(m_BoundedObjectBounds);
+	}
+
+	void RenderScene::UpdateMeshTransforms(const std::vector<TriangleMeshInstance>& triangleMeshInstances)
+	{
+		//The leaves keep their objects, so only the bounds of the meshes change and the hierarchy is refitted around them
+		for (uint32_t objectIndex{ 0 }; objectIndex < m_BoundedObjects.size(); ++objectIndex)
+		{
+			const BoundedObject& object{ m_BoundedObjects[objectIndex] };
+			switch (object.type)
+			{
+			case BoundedObjectType::SphereBlock:
+				break;
+			case BoundedObjectType::TriangleMesh:
+				m_BoundedObjectBounds[objectIndex] = m_Meshes[object.index].pMesh->bvh.GetBounds();
+				break;
+			case BoundedObjectType::TriangleMeshInstance:
+			{
+				MeshInstanceData& data{ m_MeshInstances[object.index] };
+				const TriangleMeshInstance& instance{ triangleMeshInstances[data.instanceIndex] };
+				data.worldToObject = instance.worldToObject;
+				data.normalToWorld = instance.normalToWorld;
+				m_BoundedObjectBounds[objectIndex] = instance.transformedBounds;
+				break;
+			}
+			}
+		}
+
+		m_TopLevelBVH.Refit(m_BoundedObjectBounds);
+	}
+
+	void RenderScene::BuildLights(const std::vector<Light>& lights)
+	{
+		m_Lights = lights;
+		m_LightTree.Build(m_Lights);
+	}
+
+	void RenderScene::AddMaterial(const Material& material)
+	{
+		m_Materials.push_back(material.Bake());
+	}
+
+	void RenderScene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
+	{
+		//Every test shrinks sceneRay.max, so a candidate is only accepted when it is closer than the current one
+		Ray sceneRay{ ray };
+		sceneRay.max = std::min(ray.max, closestHit.t);
+		ClosestCandidate candidate{};
+
+		for (uint32_t i{ 0 }; i < m_Planes.distance.size(); ++i)
+		{
+			if (HitTest_Plane(i, sceneRay, candidate.hit.t))
+			{
+				sceneRay.max = candidate.hit.t;
+				candidate.type = CandidateType::Plane;
+				candidate.index = i;
+			}
+		}
+
+		GeometryUtils::Traverse_BVH(m_TopLevelBVH, sceneRay, [&](uint32_t objectIndex, Ray& r)
+			{
+				if (!HitTest_BoundedObject(objectIndex, r, candidate.hit))
+					return false;
+
+				r.max = candidate.hit.t;
+				candidate.type = CandidateType::BoundedObject;
+				candidate.index = objectIndex;
+				return true;
+			});
+
+		ResolveHit(ray, candidate, closestHit);
+	}
+
+	void RenderScene::GetClosestHits(RayPacket4& packet, HitRecord closestHits[RayPacket4::Width]) const
+	{
+		//The max of every lane tracks the distance of its closest candidate
+		ClosestCandidate candidates[RayPacket4::Width]{};
+		const auto acceptLanes = [&candidates](int hitMask, CandidateType type, uint32_t index)
+			{
+				for (int lane{ 0 }; lane < RayPacket4::Width; ++lane)
+				{
+					if (hitMask & (1 << lane))
+					{
+						candidates[lane].type = type;
+						candidates[lane].index = index;
+					}
+				}
+			};
+
+		for (uint32_t i{ 0 }; i < m_Planes.distance.size(); ++i)
+		{
+			acceptLanes(HitTest_Plane(i, packet, packet.activeMask), CandidateType::Plane, i);
+		}
+
+		GeometryUtils::Traverse_BVH(m_TopLevelBVH, packet, [&](uint32_t objectIndex, RayPacket4& p, int laneMask)
+			{
+				//Spheres of a block are tested 4 lanes at a time in index order, same as the single ray kernels do on equal distances
+				const BoundedObject& object{ m_BoundedObjects[objectIndex] };
+				if (object.type == BoundedObjectType::SphereBlock)
+				{
+					int blockHitMask{ 0 };
+					const uint32_t end{ std::min(object.index + SphereKernels::BlockWidth, m_SphereCount) };
+					for (uint32_t i{ object.index }; i < end; ++i)
+					{
+						const int hitMask{ HitTest_Sphere(i, p, laneMask) };
+						acceptLanes(hitMask, CandidateType::BoundedObject, objectIndex);
+						for (int lane{ 0 }; lane < RayPacket4::Width; ++lane)
+						{
+							if (hitMask & (1 << lane))
+								candidates[lane].hit.primitiveIndex = i;
+						}
+						blockHitMask |= hitMask;
+					}
+					return blockHitMask;
+				}
+
+				//Meshes have no packet kernel, the lanes that reached them are traced one by one
+				int hitMask{ 0 };
+				alignas(16) float hitT[RayPacket4::Width]{};
+				for (int lane{ 0 }; lane < RayPacket4::Width; ++lane)
+				{
+					if (!(laneMask & (1 << lane)))
+						continue;
+
+					if (HitTest_BoundedObject(objectIndex, p.GetRay(lane), candidates[lane].hit))
+					{
+						candidates[lane].type = CandidateType::BoundedObject;
+						candidates[lane].index = objectIndex;
+						hitT[lane] = candidates[lane].hit.t;
+						hitMask |= 1 << lane;
+					}
+				}
+
+				if (hitMask != 0)
+					p.SetMax(_mm_load_ps(hitT), hitMask);
+				return hitMask;
+			});
+
+		for (int lane{ 0 }; lane < RayPacket4::Width; ++lane)
+		{
+			if (!(packet.activeMask & (1 << lane)))
+				continue;
+
+			candidates[lane].hit.t = packet.GetMax(lane);
+			ResolveHit(packet.GetRay(lane), candidates[lane], closestHits[lane]);
+		}
+	}
+
+	bool RenderScene::DoesHit(const Ray& ray) const
+	{
+		float t{};
+		for (uint32_t i{ 0 }; i < m_Planes.distance.size(); ++i)
+		{
+			if (HitTest_Plane(i, ray, t))
+				return true;
+		}
+
+		//Shadow rays only need to know whether anything is in the way, the first hit ends the traversal
+		return GeometryUtils::Traverse_BVH_AnyHit(m_TopLevelBVH, ray, [&](uint32_t objectIndex)
+			{
+				return DoesHit_BoundedObject(objectIndex, ray);
+			});
+	}
+
+	bool RenderScene::HitTest_Plane(uint32_t planeIndex, const Ray& ray, float& t) const
+	{
+		const Vector3 normal{ m_Planes.normalX[planeIndex], m_Planes.normalY[planeIndex], m_Planes.normalZ[planeIndex] };
+
+		const float hitT{ (m_Planes.distance[planeIndex] - Vector3::Dot(ray.origin, normal)) / Vector3::Dot(ray.direction, normal) };
+		if (hitT > ray.min && hitT < ray.max)
+		{
+			t = hitT;
+			return true;
+		}
+		return false;
+	}
+
+	int RenderScene::HitTest_Plane(uint32_t planeIndex, RayPacket4& packet, int laneMask) const
+	{
+		const __m128 normalX{ _mm_set1_ps(m_Planes.normalX[planeIndex]) };
+		const __m128 normalY{ _mm_set1_ps(m_Planes.normalY[planeIndex]) };
+		const __m128 normalZ{ _mm_set1_ps(m_Planes.normalZ[planeIndex]) };
+
+		const __m128 numerator{ _mm_sub_ps(_mm_set1_ps(m_Planes.distance[planeIndex]),
+			GeometryUtils::Dot(packet.originX, packet.originY, packet.originZ, normalX, normalY, normalZ)) };
+		const __m128 denominator{ GeometryUtils::Dot(packet.directionX, packet.directionY, packet.directionZ, normalX, normalY, normalZ) };
+		const __m128 t{ _mm_div_ps(numerator, denominator) };
+
+		const __m128 isHit{ _mm_and_ps(_mm_cmpgt_ps(t, packet.min), _mm_cmplt_ps(t, packet.max)) };
+		const int hitMask{ _mm_movemask_ps(isHit) & laneMask };
+		if (hitMask != 0)
+			packet.SetMax(t, hitMask);
+		return hitMask;
+	}
+
+	int RenderScene::HitTest_Sphere(uint32_t sphereIndex, RayPacket4& packet, int laneMask) const
+	{
+		const __m128 rayToSphereX{ _mm_sub_ps(packet.originX, _mm_set1_ps(m_Spheres.centerX[sphereIndex])) };
+		const __m128 rayToSphereY{ _mm_sub_ps(packet.originY, _mm_set1_ps(m_Spheres.centerY[sphereIndex])) };
+		const __m128 rayToSphereZ{ _mm_sub_ps(packet.originZ, _mm_set1_ps(m_Spheres.centerZ[sphereIndex])) };
+
+		const __m128 two{ _mm_set1_ps(2.f) };
+		const __m128 A{ GeometryUtils::Dot(packet.directionX, packet.directionY, packet.directionZ, packet.directionX, packet.directionY, packet.directionZ) };
+		const __m128 B{ GeometryUtils::Dot(_mm_mul_ps(packet.directionX, two), _mm_mul_ps(packet.directionY, two), _mm_mul_ps(packet.directionZ, two),
+			rayToSphereX, rayToSphereY, rayToSphereZ) };
+		const __m128 C{ _mm_sub_ps(GeometryUtils::Dot(rayToSphereX, rayToSphereY, rayToSphereZ, rayToSphereX, rayToSphereY, rayToSphereZ),
+			_mm_set1_ps(m_Spheres.radiusSquared[sphereIndex])) };
+		const __m128 discriminant{ _mm_sub_ps(_mm_mul_ps(B, B), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.f), A), C)) };
+
+		const __m128 hasRoots{ _mm_cmpge_ps(discriminant, _mm_setzero_ps()) };
+		if ((_mm_movemask_ps(hasRoots) & laneMask) == 0)
+			return 0;
+
+		const __m128 sqrtD{ _mm_sqrt_ps(_mm_max_ps(discriminant, _mm_setzero_ps())) };
+		const __m128 minusB{ _mm_sub_ps(_mm_setzero_ps(), B) };
+		const __m128 twoA{ _mm_mul_ps(two, A) };
+		const __m128 tNear{ _mm_div_ps(_mm_sub_ps(minusB, sqrtD), twoA) };
+		const __m128 tFar{ _mm_div_ps(_mm_add_ps(minusB, sqrtD), twoA) };
+		const __m128 t{ RayPacket4::Select(_mm_cmplt_ps(tNear, packet.min), tFar, tNear) };
+
+		const __m128 isHit{ _mm_and_ps(hasRoots, _mm_and_ps(_mm_cmple_ps(t, packet.max), _mm_cmpge_ps(t, packet.min))) };
+		const int hitMask{ _mm_movemask_ps(isHit) & laneMask };
+		if (hitMask != 0)
+			packet.SetMax(t, hitMask);
+		return hitMask;
+	}
+
+	SphereArraysView RenderScene::GetSphereBlock(uint32_t first) const
+	{
+		return { m_Spheres.centerX.data() + first, m_Spheres.centerY.data() + first, m_Spheres.centerZ.data() + first,
+			m_Spheres.radiusSquared.data() + first, SphereKernels::BlockWidth };
+	}
+
+	bool RenderScene::HitTest_BoundedObject(uint32_t objectIndex, const Ray& ray, PrimitiveHit& hit) const
+	{
+		const BoundedObject& object{ m_BoundedObjects[objectIndex] };
+		switch (object.type)
+		{
+		case BoundedObjectType::SphereBlock:
+		{
+			const uint32_t sphereIndex{ m_SphereKernels.findClosest(GetSphereBlock(object.index), ray, hit.t) };
+			if (sphereIndex == UINT32_MAX)
+				return false;
+
+			hit.primitiveIndex = object.index + sphereIndex;
+			return true;
+		}
+		case BoundedObjectType::TriangleMesh:
+		{
+			const MeshData& mesh{ m_Meshes[object.index] };
+			return GeometryUtils::HitTest_TriangleMesh(*mesh.pMesh, mesh.cullMode, ray, hit);
+		}
+		case BoundedObjectType::TriangleMeshInstance:
+		{
+			//The direction is not renormalized, which keeps t identical in object and world space
+			const MeshInstanceData& instance{ m_MeshInstances[object.index] };
+			const Ray objectRay{
+				instance.worldToObject.TransformPoint(ray.origin),
+				instance.worldToObject.TransformVector(ray.direction),
+				ray.min, ray.max
+			};
+			return GeometryUtils::HitTest_TriangleMesh(*instance.pMesh, instance.cullMode, objectRay, hit);
+		}
+		}
+		return false;
+	}
+
+	bool RenderScene::DoesHit_BoundedObject(uint32_t objectIndex, const Ray& ray) const
+	{
+		const BoundedObject& object{ m_BoundedObjects[objectIndex] };
+		switch (object.type)
+		{
+		case BoundedObjectType::SphereBlock:
+			return m_SphereKernels.doesHit(GetSphereBlock(object.index), ray);
+		case BoundedObjectType::TriangleMesh:
+		{
+			const MeshData& mesh{ m_Meshes[object.index] };
+			return GeometryUtils::HitTest_TriangleMesh(*mesh.pMesh, mesh.cullMode, ray);
+		}
+		case BoundedObjectType::TriangleMeshInstance:
+		{
+			const MeshInstanceData& instance{ m_MeshInstances[object.index] };
+			const Ray objectRay{
+				instance.worldToObject.TransformPoint(ray.origin),
+				instance.worldToObject.TransformVector(ray.direction),
+				ray.min, ray.max
+			};
+			return GeometryUtils::HitTest_TriangleMesh(*instance.pMesh, instance.cullMode, objectRay);
+		}
+		}
+		return false;
+	}
+
+	void RenderScene::ResolveHit(const Ray& ray, const ClosestCandidate& candidate, HitRecord& hitRecord) const
+	{
+		if (candidate.type == CandidateType::None)
+			return;
+
+		const float t{ candidate.hit.t };
+		hitRecord.origin = ray.origin + t * ray.direction;
+		hitRecord.t = t;
+		hitRecord.didHit = true;
+
+		const uint32_t i{ candidate.index };
+		if (candidate.type == CandidateType::Plane)
+		{
+			hitRecord.normal = Vector3{ m_Planes.normalX[i], m_Planes.normalY[i], m_Planes.normalZ[i] };
+			hitRecord.materialIndex = m_Planes.materialIndex[i];
+			return;
+		}
+
+		const BoundedObject& object{ m_BoundedObjects[i] };
+		switch (object.type)
+		{
+		case BoundedObjectType::SphereBlock:
+		{
+			const uint32_t sphereIndex{ candidate.hit.primitiveIndex };
+			const Vector3 center{ m_Spheres.centerX[sphereIndex], m_Spheres.centerY[sphereIndex], m_Spheres.centerZ[sphereIndex] };
+			hitRecord.normal = (hitRecord.origin - center) * m_Spheres.invRadius[sphereIndex];
+			hitRecord.materialIndex = m_Spheres.materialIndex[sphereIndex];
+			break;
+		}
+		case BoundedObjectType::TriangleMesh:
+		{
+			const MeshData& mesh{ m_Meshes[object.index] };
+			hitRecord.normal = mesh.pMesh->triangles[candidate.hit.primitiveIndex].normal;
+			hitRecord.materialIndex = mesh.materialIndex;
+			break;
+		}
+		case BoundedObjectType::TriangleMeshInstance:
+		{
+			const MeshInstanceData& instance{ m_MeshInstances[object.index] };
+			hitRecord.normal = instance.normalToWorld.TransformVector(instance.pMesh->triangles[candidate.hit.primitiveIndex].normal).Normalized();
+			hitRecord.materialIndex = instance.materialIndex;
+			break;
+		}
+		}
+	}
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "BVH.h"
+#include "DataTypes.h"
+#include "LightTree.h"
+#include "MaterialData.h"
+#include "RayPacket.h"
+#include "SphereKernels.h"
+
+namespace dae
+{
+	class Material;
+
+	//Read-only snapshot of a Scene in the layout the renderer traces against, Scene::Commit only rebuilds the parts that changed
+	//Spheres and planes are stored as 64-byte aligned structure of arrays with their per-primitive constants precomputed,
+	//meshes keep their own bottom-level BVH and are only referenced
+	//Spheres are grouped into blocks of SphereKernels::BlockWidth, every block is one leaf of the top-level BVH
+	//and single rays test a whole block with the widest SIMD kernel the CPU supports
+	class RenderScene final
+	{
+	public:
+		RenderScene() = default;
+		~RenderScene() = default;
+
+		RenderScene(const RenderScene&) = delete;
+		RenderScene(RenderScene&&) noexcept = delete;
+		RenderScene& operator=(const RenderScene&) = delete;
+		RenderScene& operator=(RenderScene&&) noexcept = delete;
+
+		void BuildPlanes(const std::vector<Plane>& planes);
+		//Sorts the spheres into blocks, call BuildObjects afterwards so the top-level BVH picks up the new blocks
+		void BuildSpheres(const std::vector<Sphere>& spheres);
+		/**
+		 * \brief Collects the sphere blocks, meshes and instances and builds the top-level BVH over them from scratch
+		 */
+		void BuildObjects(const std::vector<TriangleMesh>& triangleMeshes, const std::vector<TriangleMeshInstance>& triangleMeshInstances);
+		/**
+		 * \brief Picks up the new transforms and bounds of meshes that moved and refits the top-level BVH, the objects have to be the ones BuildObjects saw
+		 */
+		void UpdateMeshTransforms(const std::vector<TriangleMeshInstance>& triangleMeshInstances);
+		//Copies the lights and rebuilds the light tree over them
+		void BuildLights(const std::vector<Light>& lights);
+		//Materials cannot change once added, so each one is baked into the flat table the shading reads exactly once
+		void AddMaterial(const Material& material);
+
+		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+		//Closest hit for every active lane of the packet, spheres and planes are tested 4-wide, triangles per lane
+		void GetClosestHits(RayPacket4& packet, HitRecord closestHits[RayPacket4::Width]) const;
+		bool DoesHit(const Ray& ray) const;
+
+		const std::vector<Light>& GetLights() const { return m_Lights; }
+		const LightTree& GetLightTree() const { return m_LightTree; }
+		const std::vector<MaterialData>& GetMaterials() const { return m_Materials; }
+
+	private:
+		struct PlaneArrays
+		{
+			AlignedVector<float> normalX{}; //Unit length
+			AlignedVector<float> normalY{};
+			AlignedVector<float> normalZ{};
+			AlignedVector<float> distance{}; //Dot of the normal with any point on the plane
+			AlignedVector<unsigned char> materialIndex{};
+		};
+
+		//Sorted so neighbouring spheres share a block, padded to a multiple of SphereKernels::BlockWidth, materialIndex only holds the real spheres
+		struct SphereArrays
+		{
+			AlignedVector<float> centerX{};
+			AlignedVector<float> centerY{};
+			AlignedVector<float> centerZ{};
+			AlignedVector<float> radiusSquared{};
+			AlignedVector<float> invRadius{};
+			AlignedVector<unsigned char> materialIndex{};
+		};
+
+		struct MeshData
+		{
+			const TriangleMesh* pMesh{ nullptr };
+			TriangleCullMode cullMode{};
+			unsigned char materialIndex{};
+		};
+
+		struct MeshInstanceData
+		{
+			const TriangleMesh* pMesh{ nullptr };
+			uint32_t instanceIndex{}; //Into the instances of the scene, where moved transforms are read from
+			Matrix worldToObject{};
+			Matrix normalToWorld{};
+			TriangleCullMode cullMode{};
+			unsigned char materialIndex{};
+		};
+
+		//Objects referenced by the top-level BVH, planes are tested separately
+		enum class BoundedObjectType
+		{
+			SphereBlock, //index is the first sphere of the block
+			TriangleMesh,
+			TriangleMeshInstance
+		};
+
+		struct BoundedObject
+		{
+			BoundedObjectType type{};
+			uint32_t index{};
+		};
+
+		//Closest candidate of a search, only turned into a full HitRecord once the search is over
+		enum class CandidateType
+		{
+			None,
+			Plane,
+			BoundedObject
+		};
+
+		struct ClosestCandidate
+		{
+			PrimitiveHit hit{};
+			CandidateType type{ CandidateType::None };
+			uint32_t index{}; //Plane index or index into m_BoundedObjects
+		};
+
+		bool HitTest_Plane(uint32_t planeIndex, const Ray& ray, float& t) const;
+		int HitTest_Plane(uint32_t planeIndex, RayPacket4& packet, int laneMask) const;
+		int HitTest_Sphere(uint32_t sphereIndex, RayPacket4& packet, int laneMask) const;
+
+		//View of the block of spheres starting at first, the padding spheres of the last block are never hit
+		SphereArraysView GetSphereBlock(uint32_t first) const;
+		bool HitTest_BoundedObject(uint32_t objectIndex, const Ray& ray, PrimitiveHit& hit) const;
+		bool DoesHit_BoundedObject(uint32_t objectIndex, const Ray& ray) const;
+		void ResolveHit(const Ray& ray, const ClosestCandidate& candidate, HitRecord& hitRecord) const;
+
+		PlaneArrays m_Planes{};
+		SphereArrays m_Spheres{};
+		uint32_t m_SphereCount{};
+		std::vector<AABB> m_SphereBlockBounds{};
+		SphereKernels::KernelSet m_SphereKernels{ SphereKernels::Select() };
+		std::vector<MeshData> m_Meshes{};
+		std::vector<MeshInstanceData> m_MeshInstances{};
+
+		std::vector<BoundedObject> m_BoundedObjects{};
+		std::vector<AABB> m_BoundedObjectBounds{};
+		BVH m_TopLevelBVH{};
+
+		std::vector<Light> m_Lights{};
+		LightTree m_LightTree{};
+		std::vector<MaterialData> m_Materials{};
+	};
+}
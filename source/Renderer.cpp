@@ -2,22 +2,19 @@
 #include "SDL.h"
 #include "SDL_surface.h"
 #include <stdio.h>
-#include <omp.h>
-#include <future>
-#include <ppl.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 
 //Project includes
 #include "Renderer.h"
 #include "Math.h"
 #include "Matrix.h"
-#include "Material.h"
+#include "Random.h"
+#include "RenderScene.h"
 #include "Scene.h"
 #include "Utils.h"
 
-//Defines
-//#define ASYNC
-#define PARALLEL_FOR
-
 using namespace dae;
 
 Renderer::Renderer(SDL_Window * pWindow) :
@@ -27,252 +24,811 @@ Renderer::Renderer(SDL_Window * pWindow) :
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	m_AccumulationBuffer.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_Reservoirs.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_PreviousReservoirs.resize(static_cast<size_t>(m_Width) * m_Height);
+
+	CreateTiles();
+	SetThreadCount(0);
+}
+
+Renderer::Renderer(int width, int height) :
+	m_pBuffer(SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888)),
+	m_Width(width),
+	m_Height(height)
+{
+	if (!m_pBuffer)
+	{
+		std::cout << "Could not create the " << width << "x" << height << " framebuffer: " << SDL_GetError() << std::endl;
+		return;
+	}
+
+	//Initialize
+	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	m_AccumulationBuffer.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_Reservoirs.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_PreviousReservoirs.resize(static_cast<size_t>(m_Width) * m_Height);
+
+	CreateTiles();
+	SetThreadCount(0);
+}
+
+Renderer::~Renderer()
+{
+	//The window owns its surface, only a headless framebuffer is ours to free
+	if (!m_pWindow)
+		SDL_FreeSurface(m_pBuffer);
 }
 
-void Renderer::Render(Scene* pScene) const
+void Renderer::Render(Scene* pScene)
 {
+	pScene->Commit();
+	const RenderScene* pRenderScene{ &pScene->GetRenderScene() };
+
 	Camera& camera{ pScene->GetCamera() };
-	camera.CalculateCameraToWorld();
+	const Matrix cameraToWorld{ camera.CalculateCameraToWorld() };
 
-	const float fov{ tan((camera.fovAngle * TO_RADIANS) / 2.f) };
+	//Reservoirs of another scene point at lights that do not exist here
+	if (pScene != m_pAccumulatedScene)
+		std::fill(m_PreviousReservoirs.begin(), m_PreviousReservoirs.end(), LightReservoir{});
 
-	auto& materials{ pScene->GetMaterials() };
-	auto& lights{ pScene->GetLights() };
+	//Anything that changes the image makes the frames accumulated so far invalid
+	if (!m_AccumulationEnabled || camera.hasMoved || pScene != m_pAccumulatedScene || pScene->GetVersion() != m_AccumulatedSceneVersion)
+	{
+		ResetAccumulation();
+		m_pAccumulatedScene = pScene;
+		m_AccumulatedSceneVersion = pScene->GetVersion();
+	}
+	++m_AccumulatedFrames;
+	++m_FrameIndex;
 
+	const float fov{ tan((camera.fovAngle * TO_RADIANS) / 2.f) };
 	const float aspectRatio{ m_Width / static_cast<float>(m_Height) };
+	const ViewRayGenerator viewRays{ CreateViewRayGenerator(fov, aspectRatio, cameraToWorld) };
 
-	// const float FOV{ tan((camera.fovAngle * TO_RADIANS) / 2) };
+	auto& materials{ pRenderScene->GetMaterials() };
+	auto& lights{ pRenderScene->GetLights() };
 
-	const uint32_t numPixels = m_Width * m_Height;
+	const uint32_t numTiles{ static_cast<uint32_t>(m_Tiles.size()) };
 
-	#if defined(ASYNC)
-	//async logic
-	const uint32_t numCores = std::thread::hardware_concurrency();
-	std::vector<std::future<void>> async_futures{};
+	if (m_ThreadingMode == ThreadingMode::ThreadPool)
+	{
+		m_pThreadPool->ParallelFor(numTiles, [&](uint32_t tileIndex)
+			{
+				RenderTile(pRenderScene, tileIndex, viewRays, lights, materials);
+			});
+	}
+	else
+	{
+		for (uint32_t i = 0; i < numTiles; ++i)
+		{
+			RenderTile(pRenderScene, i, viewRays, lights, materials);
+		}
+	}
 
-	const uint32_t numPixelPerTask{ numPixels / numCores };
-	uint32_t numAssignedPixels = numPixels % numCores;
-	uint32_t currentPixelIndex = 0;
+	//The reservoirs of this frame are the temporal and spatial history of the next one
+	if (m_DirectLightingMode == DirectLightingMode::Reservoir)
+		std::swap(m_Reservoirs, m_PreviousReservoirs);
 
-	for (uint32_t coreId{ 0 }; coreId < numCores; ++coreId)
+	//@END
+	//Update SDL Surface
+	if (m_pWindow)
+		SDL_UpdateWindowSurface(m_pWindow);
+}
+
+void Renderer::RenderTile(const RenderScene* pRenderScene, uint32_t tileIndex, const ViewRayGenerator& viewRays,
+						  const std::vector<Light>& lights, const std::vector<MaterialData>& materials)
+{
+	const auto startTime{ std::chrono::steady_clock::now() };
+
+	const Tile& tile{ m_Tiles[tileIndex] };
+	if (m_WavefrontEnabled)
+	{
+		RenderTileWavefront(pRenderScene, tile, viewRays, lights, materials);
+	}
+	else if (m_PacketTracingEnabled)
+	{
+		for (int py{ tile.y }; py < tile.y + tile.height; py += 2)
+		{
+			for (int px{ tile.x }; px < tile.x + tile.width; px += 2)
+			{
+				RenderPacket(pRenderScene, px, py, tile, viewRays, lights, materials);
+			}
+		}
+	}
+	else
 	{
-		uint32_t taskSize{ numPixelPerTask };
-		if (numAssignedPixels > 0)
+		for (int py{ tile.y }; py < tile.y + tile.height; ++py)
 		{
-			++taskSize;
-			--numAssignedPixels;
+			for (int px{ tile.x }; px < tile.x + tile.width; ++px)
+			{
+				RenderPixel(pRenderScene, px + py * m_Width, viewRays, lights, materials);
+			}
 		}
+	}
+
+	const std::chrono::duration<float, std::milli> tileTime{ std::chrono::steady_clock::now() - startTime };
+	m_TileRenderTimes[tileIndex] = tileTime.count();
+}
+
+void Renderer::RenderPixel(const RenderScene* pRenderScene, uint32_t pixelIndex, const ViewRayGenerator& viewRays,
+						   const std::vector<Light>& lights, const std::vector<MaterialData>& materials)
+{
+	const int px = pixelIndex % m_Width;
+	const int py = pixelIndex  / m_Width;
 
-		async_futures.push_back(
-			std::async(std::launch::async, [=, this]
-				{
-					const uint32_t endPixelIndex{ currentPixelIndex + taskSize };
-					for (uint32_t pixelIndex{ currentPixelIndex }; pixelIndex < endPixelIndex; ++pixelIndex)
-					{
-						RenderPixel(pScene, pixelIndex, fov, aspectRatio, camera, lights, materials);
-					}
-				})
-		);
-		currentPixelIndex += taskSize;
+	const Ray viewRay{ viewRays.Generate(px, py) };
+
+	HitRecord closestHit{};
+	pRenderScene->GetClosestHit(viewRay, closestHit);
+
+	ShadePixel(pRenderScene, pixelIndex, viewRay, closestHit, lights, materials);
+}
+
+void Renderer::RenderPacket(const RenderScene* pRenderScene, int px, int py, const Tile& tile, const ViewRayGenerator& viewRayGenerator,
+							const std::vector<Light>& lights, const std::vector<MaterialData>& materials)
+{
+	Ray viewRays[RayPacket4::Width]{};
+	uint32_t pixelIndices[RayPacket4::Width]{};
+	int laneMask{ 0 };
+	for (int lane{ 0 }; lane < RayPacket4::Width; ++lane)
+	{
+		const int x{ px + (lane & 1) };
+		const int y{ py + (lane >> 1) };
+		if (x >= tile.x + tile.width || y >= tile.y + tile.height)
+			continue;
+
+		viewRays[lane] = viewRayGenerator.Generate(x, y);
+		pixelIndices[lane] = x + y * m_Width;
+		laneMask |= 1 << lane;
 	}
 
-	//wait until all tasks are finished
-	for (const std::future<void>& f : async_futures)
+	RayPacket4 packet{};
+	packet.SetRays(viewRays, laneMask);
+
+	HitRecord closestHits[RayPacket4::Width]{};
+	pRenderScene->GetClosestHits(packet, closestHits);
+
+	//Shading stays per pixel, secondary rays are no longer coherent enough to benefit from packets
+	for (int lane{ 0 }; lane < RayPacket4::Width; ++lane)
 	{
-		f.wait();
+		if (laneMask & (1 << lane))
+			ShadePixel(pRenderScene, pixelIndices[lane], viewRays[lane], closestHits[lane], lights, materials);
 	}
+}
 
-	#elif defined(PARALLEL_FOR)
-	//parallel for logic
+Renderer::ViewRayGenerator Renderer::CreateViewRayGenerator(float fov, float aspectRatio, const Matrix& cameraToWorld) const
+{
+	//Camera space x of a pixel center is (2 * (px + 0.5) / width - 1) * aspectRatio * fov, a linear function of px, the same goes for y
+	//Transforming that linear function once gives the world direction of pixel (0, 0) and the steps to its neighbours
+	const float scaleX{ 2.f * aspectRatio * fov / m_Width };
+	const float scaleY{ -2.f * fov / m_Height };
+	const float firstX{ (1.f / m_Width - 1.f) * aspectRatio * fov };
+	const float firstY{ (1.f - 1.f / m_Height) * fov };
+
+	ViewRayGenerator generator{};
+	generator.origin = Vector3{ cameraToWorld[3] };
+	generator.firstDirection = cameraToWorld.TransformVector(firstX, firstY, 1.f);
+	generator.stepX = cameraToWorld.TransformVector(scaleX, 0.f, 0.f);
+	generator.stepY = cameraToWorld.TransformVector(0.f, scaleY, 0.f);
+	return generator;
+}
 
-	concurrency::parallel_for(0u, numPixels, [=, this](int pixelIndex)
+void Renderer::RenderTileWavefront(const RenderScene* pRenderScene, const Tile& tile, const ViewRayGenerator& viewRays,
+								   const std::vector<Light>& lights, const std::vector<MaterialData>& materials)
+{
+	//Every render thread keeps its own queues, they only grow until they fit the largest tile
+	thread_local WavefrontQueues queues{};
+	queues.Clear();
+
+	GenerateRays(tile, viewRays, queues);
+	IntersectRays(pRenderScene, viewRays.origin, queues);
+	ShadeHits(pRenderScene, viewRays.origin, lights, materials, queues);
+	TraceShadowRays(pRenderScene, queues);
+
+	for (uint32_t slot{ 0 }; slot < queues.rays.GetSize(); ++slot)
+	{
+		WritePixel(queues.rays.pixelIndex[slot], queues.radiance[slot]);
+	}
+}
+
+void Renderer::GenerateRays(const Tile& tile, const ViewRayGenerator& viewRays, WavefrontQueues& queues) const
+{
+	for (int py{ tile.y }; py < tile.y + tile.height; py += 2)
+	{
+		for (int px{ tile.x }; px < tile.x + tile.width; px += 2)
 		{
-			RenderPixel(pScene, pixelIndex, fov, aspectRatio, camera, lights, materials);
-		});
+			for (int lane{ 0 }; lane < RayPacket4::Width; ++lane)
+			{
+				const int x{ px + (lane & 1) };
+				const int y{ py + (lane >> 1) };
+				if (x >= tile.x + tile.width || y >= tile.y + tile.height)
+					continue;
+
+				queues.rays.Push(viewRays.GetDirection(x, y), x + y * m_Width);
+			}
+		}
+	}
+
+	queues.radiance.assign(queues.rays.GetSize(), ColorRGB{});
+}
+
+void Renderer::IntersectRays(const RenderScene* pRenderScene, const Vector3& origin, WavefrontQueues& queues)
+{
+	const WavefrontQueues::RayQueue& rays{ queues.rays };
+	const uint32_t numRays{ rays.GetSize() };
+	const auto getRay = [&](uint32_t slot)
+		{
+			return Ray{ origin, Vector3{ rays.directionX[slot], rays.directionY[slot], rays.directionZ[slot] } };
+		};
 
-	#else
-	//No Threading
-	for (uint32_t i = 0; i < numPixels; ++i)
+	const auto queueHit = [&](uint32_t slot, const HitRecord& closestHit)
+		{
+			if (closestHit.didHit)
+			{
+				queues.hits.hits.push_back(closestHit);
+				queues.hits.raySlot.push_back(slot);
+			}
+			else if (m_DirectLightingMode == DirectLightingMode::Reservoir)
+			{
+				m_Reservoirs[rays.pixelIndex[slot]] = {};
+			}
+		};
+
+	if (!m_PacketTracingEnabled)
 	{
-		RenderPixel(pScene, i, fov, aspectRatio, camera, lights, materials);
+		for (uint32_t slot{ 0 }; slot < numRays; ++slot)
+		{
+			HitRecord closestHit{};
+			pRenderScene->GetClosestHit(getRay(slot), closestHit);
+			queueHit(slot, closestHit);
+		}
+		return;
 	}
-	#endif
 
+	//The rays were generated in 2x2 blocks, every 4 consecutive ones are traced as one packet
+	for (uint32_t first{ 0 }; first < numRays; first += RayPacket4::Width)
+	{
+		Ray viewRays[RayPacket4::Width]{};
+		int laneMask{ 0 };
+		for (uint32_t lane{ 0 }; lane < RayPacket4::Width && first + lane < numRays; ++lane)
+		{
+			viewRays[lane] = getRay(first + lane);
+			laneMask |= 1 << lane;
+		}
 
-	//@END
-	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+		RayPacket4 packet{};
+		packet.SetRays(viewRays, laneMask);
+
+		HitRecord closestHits[RayPacket4::Width]{};
+		pRenderScene->GetClosestHits(packet, closestHits);
+
+		for (uint32_t lane{ 0 }; lane < RayPacket4::Width; ++lane)
+		{
+			if (laneMask & (1 << lane))
+				queueHit(first + lane, closestHits[lane]);
+		}
+	}
 }
 
-void Renderer::RenderPixel(const Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio,
-						   const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const
+void Renderer::ShadeHits(const RenderScene* pRenderScene, const Vector3& origin, const std::vector<Light>& lights,
+						 const std::vector<MaterialData>& materials, WavefrontQueues& queues)
 {
-	const int px = pixelIndex % m_Width;
-	const int py = pixelIndex  / m_Width;
+	const WavefrontQueues::RayQueue& rays{ queues.rays };
+	for (uint32_t i{ 0 }; i < queues.hits.GetSize(); ++i)
+	{
+		const HitRecord& closestHit{ queues.hits.hits[i] };
+		const uint32_t slot{ queues.hits.raySlot[i] };
+		const uint32_t pixelIndex{ rays.pixelIndex[slot] };
+		const Ray viewRay{ origin, Vector3{ rays.directionX[slot], rays.directionY[slot], rays.directionZ[slot] } };
+		const MaterialData& material{ materials[closestHit.materialIndex] };
 
-	const float rx{ px + 0.5f};
-	const float ry{ py + 0.5f };
+		//Same generator and draw order as ShadePixel, both render paths pick the same light samples
+		PCG32 rng{ HashSeed(pixelIndex, m_AccumulatedFrames) };
 
-	const float cx{ (2 * (rx / m_Width) - 1) * aspectRatio * fov };
-	const float cy{ (1 - (2 * (ry / m_Height))) * fov };
+		switch (m_DirectLightingMode)
+		{
+		case DirectLightingMode::AllLights:
+			for (const Light& light : lights)
+			{
+				QueueLightSamples(light, viewRay, closestHit, material, 1.f, slot, rng, queues);
+			}
+			break;
+		case DirectLightingMode::LightTree:
+		{
+			const LightTree& lightTree{ pRenderScene->GetLightTree() };
+			const int numSamples{ IsAccumulating() ? LightTreeSamplesAccumulated : LightTreeSamplesSingleFrame };
+			for (int sampleIndex{ 0 }; sampleIndex < numSamples; ++sampleIndex)
+			{
+				float pdf{};
+				const uint32_t lightIndex{ lightTree.Sample(closestHit.origin, closestHit.normal, rng.NextFloat(), pdf) };
+				//A dead branch still counts as one of the samples, the ones after it keep their 1 / numSamples weight
+				if (lightIndex == LightTree::InvalidLight)
+					continue;
+
+				QueueLightSamples(lights[lightIndex], viewRay, closestHit, material, 1.f / (pdf * numSamples), slot, rng, queues);
+			}
+			break;
+		}
+		case DirectLightingMode::Reservoir:
+			//A reservoir ends in a single sample, its shadow ray is traced right away
+			queues.radiance[slot] += ShadeReservoir(pRenderScene, pixelIndex, viewRay, closestHit, lights, material);
+			break;
+		}
+	}
+}
+
+void Renderer::QueueLightSamples(const Light& light, const Ray& viewRay, const HitRecord& closestHit, const MaterialData& material,
+								 float weight, uint32_t slot, PCG32& rng, WavefrontQueues& queues) const
+{
+	ColorRGB contribution{};
+	const auto queueSample = [&](const LightUtils::LightSample& sample, float sampleWeight)
+		{
+			if (!EvaluateLightSample(sample, closestHit, viewRay, material, contribution))
+				return;
+
+			contribution *= sampleWeight;
+			if (m_ShadowsEnabled)
+				queues.shadowRays.Push(closestHit.origin, sample.direction, sample.distance, contribution, slot);
+			else
+				queues.radiance[slot] += contribution;
+		};
+
+	if (!LightUtils::IsAreaLight(light))
+	{
+		queueSample(LightUtils::SampleLight(light, closestHit.origin, 0.f, 0.f), weight);
+		return;
+	}
 
-	Vector3 rayDirection{ cx, cy, 1 };
-	Camera cam{ camera };
-	rayDirection = cam.CalculateCameraToWorld().TransformVector(rayDirection);
+	//Whether a sample is in shadow is only known once the shadow stage ran, adaptive shadows do not apply here
+	const int numSamples{ IsAccumulating() ? AreaLightSamplesAccumulated : AreaLightSamplesSingleFrame };
+	const float offsetU{ rng.NextFloat() };
+	const float offsetV{ rng.NextFloat() };
+	for (int i{ 0 }; i < numSamples; ++i)
+	{
+		float u{};
+		float v{};
+		GetAreaLightSampleCoordinates(i, 0, numSamples, numSamples, offsetU, offsetV, rng, u, v);
+		queueSample(LightUtils::SampleLight(light, closestHit.origin, u, v), weight / numSamples);
+	}
+}
+
+void Renderer::TraceShadowRays(const RenderScene* pRenderScene, WavefrontQueues& queues) const
+{
+	const WavefrontQueues::ShadowRayQueue& shadowRays{ queues.shadowRays };
+	for (uint32_t i{ 0 }; i < shadowRays.GetSize(); ++i)
+	{
+		const Ray shadowRay{
+			Vector3{ shadowRays.originX[i], shadowRays.originY[i], shadowRays.originZ[i] },
+			Vector3{ shadowRays.directionX[i], shadowRays.directionY[i], shadowRays.directionZ[i] },
+			0.1f, shadowRays.distance[i] };
+
+		if (!pRenderScene->DoesHit(shadowRay))
+			queues.radiance[shadowRays.raySlot[i]] += ColorRGB{ shadowRays.contributionR[i], shadowRays.contributionG[i], shadowRays.contributionB[i] };
+	}
+}
 
-	const Ray viewRay(camera.origin, rayDirection);
+void Renderer::ShadePixel(const RenderScene* pRenderScene, uint32_t pixelIndex, const Ray& viewRay, const HitRecord& closestHit,
+						  const std::vector<Light>& lights, const std::vector<MaterialData>& materials)
+{
 	ColorRGB finalColor{};
 
-	HitRecord closestHit{};
-	pScene->GetClosestHit(viewRay, closestHit);
+	//Seeded per pixel and frame instead of sharing rand(), the image no longer depends on which thread rendered it
+	PCG32 rng{ HashSeed(pixelIndex, m_AccumulatedFrames) };
 
 
 	if (closestHit.didHit)
 	{
-		for (auto& light : lights)
+		const MaterialData& material{ materials[closestHit.materialIndex] };
+		switch (m_DirectLightingMode)
 		{
-			ColorRGB E{};
-			Vector3 directionToLight{};
-			float lambertCos{};
-			if (light.type == LightType::AreaRect || light.type == LightType::AreaCircle || light.type == LightType::AreaSphere)
+		case DirectLightingMode::AllLights:
+			for (const Light& light : lights)
 			{
-				const int numSamples{ 16 }; // Number of samples
-				const float sampleWeight { 1.0f / numSamples };
-
-				for (int i = 0; i < numSamples; ++i)
-				{
-					// Generate random samples in the range [0, 1)
-					float u {static_cast<float>(rand()) / RAND_MAX};
-					float v {static_cast<float>(rand()) / RAND_MAX};
-
-					Vector3 samplePoint{};
-					if (light.type == LightType::AreaRect)
-					{
-						// Map samples to the area light's surface
-						samplePoint = light.origin + (u - 0.5f) * light.width * light.right + (v - 0.5f) * light.height * light.up;
-					}
-					else if (light.type == LightType::AreaCircle)
-					{
-						// Map samples to the area light's surface
-						const float phi{ std::sqrt(u) };
-						const double theta{ 2.0f * M_PI * v };
-						
-						// Calculate the sampled point on the round area light's surface
-						samplePoint = light.origin + phi * light.height * (std::cos(theta) * light.right + std::sin(theta) * light.up);
-					}
-					else
-					{
-						const double phi{ 2.0f * M_PI * u };
-						const double theta {std::acos(1.0f - 2.0f * v) };
-
-						Vector3 sampleDirection(
-							std::sin(theta) * std::cos(phi),
-							std::sin(theta) * std::sin(phi),
-							std::cos(theta)
-						);
-
-						// Calculate the sampled point on the spherical area light's surface
-						samplePoint = light.origin + light.height * sampleDirection;
-					}
-
-
-					// Calculate direction from the hit point to the sampled point on the area light
-					Vector3 directionToLight{ samplePoint - closestHit.origin };
-					const Vector3 nInvLightRay{ directionToLight.Normalized() };
-					const float distanceSq{ directionToLight.SqrMagnitude() };
-
-
-					lambertCos = Vector3::Dot(closestHit.normal, directionToLight.Normalized());
-					if (lambertCos < 0)
-					{
-						continue;
-					}
-
-					if (m_ShadowsEnabled)
-					{
-						const Ray lray{ closestHit.origin, nInvLightRay,0.1f, directionToLight.Magnitude() };
-
-						if (pScene->DoesHit(lray))
-						{
-							continue;
-						}
-					}
-
-					// Calculate radiance contribution from the sampled point
-					E += light.color * (light.intensity / distanceSq);
-
-					switch (m_CurrentLightingMode)
-					{
-					case LightingMode::Combined:
-						finalColor += E * materials[closestHit.materialIndex]->Shade(closestHit, nInvLightRay, -viewRay.direction) * lambertCos * sampleWeight;
-						break;
-					case LightingMode::ObservedArea:
-						finalColor += ColorRGB(1, 1, 1) * lambertCos * sampleWeight;;
-						break;
-					case LightingMode::Radiance:
-						finalColor += E * sampleWeight;;
-						break;
-					case LightingMode::BRDF:
-						finalColor += materials[closestHit.materialIndex]->Shade(closestHit, nInvLightRay, -viewRay.direction) * sampleWeight;;
-						break;
-					}
-				}
-
+				finalColor += ShadeLight(pRenderScene, light, viewRay, closestHit, material, rng);
 			}
-			else
+			break;
+		case DirectLightingMode::LightTree:
+		{
+			//Every sample picks a single light in proportion to its estimated contribution, dividing by the pick probability keeps the sum unbiased
+			const LightTree& lightTree{ pRenderScene->GetLightTree() };
+			const int numSamples{ IsAccumulating() ? LightTreeSamplesAccumulated : LightTreeSamplesSingleFrame };
+			for (int i{ 0 }; i < numSamples; ++i)
 			{
-				E = LightUtils::GetRadiance(light, closestHit.origin);
-				directionToLight = LightUtils::GetDirectionToLight(light, closestHit.origin);
-				lambertCos = Vector3::Dot(closestHit.normal, directionToLight.Normalized());
-				if (lambertCos < 0)
-				{
+				float pdf{};
+				const uint32_t lightIndex{ lightTree.Sample(closestHit.origin, closestHit.normal, rng.NextFloat(), pdf) };
+				//A dead branch still counts as one of the samples, the ones after it keep their 1 / numSamples weight
+				if (lightIndex == LightTree::InvalidLight)
 					continue;
-				}
-				const Vector3 invLightRay{ directionToLight };
-				const Vector3 nInvLightRay{ invLightRay.Normalized() };
-				if (m_ShadowsEnabled)
-				{
-					const Ray lray{ closestHit.origin, nInvLightRay,0.1f, invLightRay.Magnitude() };
-
-					if (pScene->DoesHit(lray))
-					{
-						continue;
-					}
-				}
-
-				switch (m_CurrentLightingMode)
-				{
-				case LightingMode::Combined:
-					finalColor += E * materials[closestHit.materialIndex]->Shade(closestHit, nInvLightRay, -viewRay.direction) * lambertCos;
-					break;
-				case LightingMode::ObservedArea:
-					finalColor += ColorRGB(1, 1, 1) * lambertCos;
-					break;
-				case LightingMode::Radiance:
-					finalColor += E;
-					break;
-				case LightingMode::BRDF:
-					finalColor += materials[closestHit.materialIndex]->Shade(closestHit, nInvLightRay, -viewRay.direction);
-					break;
-				}
-			}
 
+				finalColor += ShadeLight(pRenderScene, lights[lightIndex], viewRay, closestHit, material, rng) * (1.f / (pdf * numSamples));
+			}
+			break;
+		}
+		case DirectLightingMode::Reservoir:
+			finalColor += ShadeReservoir(pRenderScene, pixelIndex, viewRay, closestHit, lights, material);
+			break;
 		}
 	}
+	else if (m_DirectLightingMode == DirectLightingMode::Reservoir)
+	{
+		m_Reservoirs[pixelIndex] = {};
+	}
+
+	WritePixel(pixelIndex, finalColor);
+}
+
+void Renderer::WritePixel(uint32_t pixelIndex, const ColorRGB& finalColor)
+{
+	//Accumulate, the first frame after a reset overwrites so the buffer never needs clearing
+	ColorRGB& accumulatedColor{ m_AccumulationBuffer[pixelIndex] };
+	if (m_AccumulatedFrames == 1)
+		accumulatedColor = finalColor;
+	else
+		accumulatedColor += finalColor;
 
 	//Update Color in Buffer
-	finalColor.MaxToOne();
+	ColorRGB displayColor{ accumulatedColor };
+	displayColor *= 1.f / m_AccumulatedFrames;
+	displayColor.MaxToOne();
+
+	m_pBufferPixels[pixelIndex] = SDL_MapRGB(m_pBuffer->format,
+		static_cast<uint8_t>(displayColor.r * 255),
+		static_cast<uint8_t>(displayColor.g * 255),
+		static_cast<uint8_t>(displayColor.b * 255));
+
+}
+
+ColorRGB Renderer::ShadeLight(const RenderScene* pRenderScene, const Light& light, const Ray& viewRay, const HitRecord& closestHit,
+							  const MaterialData& material, PCG32& rng) const
+{
+	ColorRGB finalColor{};
+	ColorRGB contribution{};
+	if (!LightUtils::IsAreaLight(light))
+	{
+		const LightUtils::LightSample sample{ LightUtils::SampleLight(light, closestHit.origin, 0.f, 0.f) };
+		if (EvaluateLightSample(sample, closestHit, viewRay, material, contribution) && !IsOccluded(pRenderScene, closestHit, sample))
+			finalColor += contribution;
+		return finalColor;
+	}
+
+	//Adaptive shadows only pay off with a budget well above the initial set, accumulated frames take too few samples
+	//They do apply to the first frame after a reset, which is every frame of an animated scene
+	const bool adaptive{ m_AdaptiveShadows.enabled && !IsAccumulating() && m_AdaptiveShadows.maxSamples > m_AdaptiveShadows.initialSamples };
+	const int maxSamples{ IsAccumulating() ? AreaLightSamplesAccumulated : (adaptive ? m_AdaptiveShadows.maxSamples : AreaLightSamplesSingleFrame) };
+	const int initialSamples{ adaptive ? std::max(m_AdaptiveShadows.initialSamples, 1) : maxSamples };
+
+	//Every pixel shifts the shared Halton points by its own offset, otherwise all pixels would sample the same spots
+	const float offsetU{ rng.NextFloat() };
+	const float offsetV{ rng.NextFloat() };
+
+	//Takes the i-th of count samples, the initial set and the rest of the budget are each stratified over the whole light
+	//Counts whether the shadow ray reached the light, samples below the surface need no shadow ray and are not counted
+	int numLit{ 0 };
+	int numOccluded{ 0 };
+	const auto takeSample = [&](int i, int first, int count, bool traceShadowRay)
+		{
+			float u{};
+			float v{};
+			GetAreaLightSampleCoordinates(i, first, count, maxSamples, offsetU, offsetV, rng, u, v);
+
+			const LightUtils::LightSample sample{ LightUtils::SampleLight(light, closestHit.origin, u, v) };
+			if (!EvaluateLightSample(sample, closestHit, viewRay, material, contribution))
+				return;
+
+			if (traceShadowRay && IsOccluded(pRenderScene, closestHit, sample))
+			{
+				++numOccluded;
+				return;
+			}
+
+			++numLit;
+			finalColor += contribution;
+		};
+
+	for (int i = 0; i < initialSamples; ++i)
+		takeSample(i, 0, initialSamples, true);
+
+	if (initialSamples == maxSamples)
+		return finalColor * (1.f / maxSamples);
+
+	//The initial shadow rays decide for the rest of the budget, only penumbrae, where they disagree, keep tracing shadow rays
+	//Fully lit points still take every light sample since the light itself is not uniform over its surface, umbrae stop right away
+	//When every initial sample fell below the horizon nothing is known about the visibility, so the rest keeps tracing shadow rays
+	const int numTraced{ numLit + numOccluded };
+	const float disagreement{ numTraced > 0 ? static_cast<float>(std::min(numLit, numOccluded)) / numTraced : 0.f };
+	const bool isPenumbra{ disagreement > m_AdaptiveShadows.penumbraThreshold };
+	if (!isPenumbra && numLit < numOccluded)
+		return finalColor * (1.f / initialSamples);
+
+	const bool traceShadowRays{ isPenumbra || numTraced == 0 };
+	const int remainingSamples{ maxSamples - initialSamples };
+	for (int i = 0; i < remainingSamples; ++i)
+		takeSample(i, initialSamples, remainingSamples, traceShadowRays);
+
+	return finalColor * (1.f / maxSamples);
+}
+
+void Renderer::GetAreaLightSampleCoordinates(int index, int first, int count, int numSamples, float offsetU, float offsetV, PCG32& rng, float& u, float& v) const
+{
+	if (m_SamplingMode == SamplingMode::Halton)
+	{
+		//Any prefix of the Halton sequence is already spread over the light
+		//The first frame takes the larger single-frame budget, later frames continue the sequence after it
+		const uint32_t firstFrameSamples{ static_cast<uint32_t>(std::max(AreaLightSamplesSingleFrame, m_AdaptiveShadows.maxSamples)) };
+		const uint32_t frameOffset{ m_AccumulatedFrames == 1 ? 0u : firstFrameSamples + (m_AccumulatedFrames - 2) * numSamples };
+		const uint32_t sampleIndex{ frameOffset + first + index };
+		u = RotateSample(RadicalInverse(sampleIndex, 2), offsetU);
+		v = RotateSample(RadicalInverse(sampleIndex, 3), offsetV);
+	}
+	else
+	{
+		//One jittered sample per cell of a grid over the light, spreads the samples without the clumping of independent ones
+		const float jitterU{ rng.NextFloat() };
+		const float jitterV{ rng.NextFloat() };
+		StratifiedSample(index, count, jitterU, jitterV, u, v);
+	}
+}
+
+ColorRGB Renderer::ShadeReservoir(const RenderScene* pRenderScene, uint32_t pixelIndex, const Ray& viewRay, const HitRecord& closestHit,
+								  const std::vector<Light>& lights, const MaterialData& material)
+{
+	//Own stream seeded with the frame index, the reused samples have to keep changing even while accumulation is off
+	PCG32 rng{ HashSeed(pixelIndex, m_FrameIndex), 2 };
+	const LightTree& lightTree{ pRenderScene->GetLightTree() };
+
+	//The target density is the luminance of the unshadowed irradiance, the resampled light samples end up distributed close to it
+	//The material is left out, it is only evaluated once for the sample that survives
+	const auto getTargetPdf = [&](uint32_t lightIndex, float u, float v)
+		{
+			const LightUtils::LightSample candidate{ LightUtils::SampleLight(lights[lightIndex], closestHit.origin, u, v) };
+			const float lambertCos{ Vector3::Dot(closestHit.normal, candidate.direction) };
+			return lambertCos > 0.f && candidate.pdf > 0.f ? candidate.radiance.Luminance() * lambertCos / candidate.pdf : 0.f;
+		};
+
+	LightReservoir reservoir{};
+	reservoir.normal = closestHit.normal;
+	reservoir.hitDistance = closestHit.t;
+
+	//Initial candidates from the light tree, no shadow rays are traced for them
+	for (int i{ 0 }; i < ReservoirCandidates; ++i)
+	{
+		float lightPdf{};
+		const uint32_t lightIndex{ lightTree.Sample(closestHit.origin, closestHit.normal, rng.NextFloat(), lightPdf) };
+		if (lightIndex == LightTree::InvalidLight)
+		{
+			reservoir.sampleCount += 1.f;
+			continue;
+		}
+
+		const float u{ rng.NextFloat() };
+		const float v{ rng.NextFloat() };
+		const float targetPdf{ getTargetPdf(lightIndex, u, v) };
+		reservoir.Update(lightIndex, u, v, targetPdf, targetPdf / lightPdf, rng.NextFloat());
+	}
+
+	//Reuse the reservoirs of the previous frame at this pixel and at a few random neighbours
+	//Their sample counts are capped so old history cannot drown out a change in lighting
+	const float maxHistory{ static_cast<float>(ReservoirMaxHistory * ReservoirCandidates) };
+	const auto reuse = [&](const LightReservoir& other)
+		{
+			if (other.sampleCount <= 0.f || other.lightIndex >= lights.size())
+				return;
+
+			//Only reuse samples from a similar surface, across edges the sample would be weighted for the wrong geometry
+			if (Vector3::Dot(other.normal, closestHit.normal) < 0.9f || std::abs(other.hitDistance - closestHit.t) > 0.1f * closestHit.t)
+				return;
+
+			LightReservoir capped{ other };
+			capped.sampleCount = std::min(other.sampleCount, maxHistory);
+			reservoir.Merge(capped, getTargetPdf(other.lightIndex, other.u, other.v), rng.NextFloat());
+		};
+
+	reuse(m_PreviousReservoirs[pixelIndex]);
+
+	const int px{ static_cast<int>(pixelIndex % m_Width) };
+	const int py{ static_cast<int>(pixelIndex / m_Width) };
+	for (int i{ 0 }; i < ReservoirSpatialNeighbours; ++i)
+	{
+		const float radius{ ReservoirSpatialRadius * std::sqrt(rng.NextFloat()) };
+		const float angle{ 2.f * PI * rng.NextFloat() };
+		const int nx{ std::clamp(px + static_cast<int>(radius * std::cos(angle)), 0, m_Width - 1) };
+		const int ny{ std::clamp(py + static_cast<int>(radius * std::sin(angle)), 0, m_Height - 1) };
+		reuse(m_PreviousReservoirs[nx + ny * m_Width]);
+	}
+
+	reservoir.FinalizeWeight();
+
+	//A single shadow ray for the surviving sample
+	//Visibility is not stored in the reservoir, a sample occluded here can still be the right pick for a neighbour
+	ColorRGB finalColor{};
+	if (reservoir.IsValid())
+	{
+		const LightUtils::LightSample sample{ LightUtils::SampleLight(lights[reservoir.lightIndex], closestHit.origin, reservoir.u, reservoir.v) };
+		ColorRGB contribution{};
+		if (EvaluateLightSample(sample, closestHit, viewRay, material, contribution) && !IsOccluded(pRenderScene, closestHit, sample))
+			finalColor += contribution * reservoir.contributionWeight;
+	}
+
+	m_Reservoirs[pixelIndex] = reservoir;
+	return finalColor;
+}
+
+bool Renderer::EvaluateLightSample(const LightUtils::LightSample& sample, const HitRecord& closestHit, const Ray& viewRay, const MaterialData& material, ColorRGB& contribution) const
+{
+	const float lambertCos{ Vector3::Dot(closestHit.normal, sample.direction) };
+	if (lambertCos < 0 || sample.pdf <= 0.f)
+		return false;
+
+	//Radiance divided by the density it was sampled with, a single sample is then an estimate of the light over the whole light
+	const ColorRGB incidentRadiance{ sample.radiance * (1.f / sample.pdf) };
+
+	switch (m_CurrentLightingMode)
+	{
+	case LightingMode::Combined:
+		contribution = incidentRadiance * material.Shade(closestHit.normal, sample.direction, -viewRay.direction) * lambertCos;
+		break;
+	case LightingMode::ObservedArea:
+		contribution = ColorRGB(1, 1, 1) * lambertCos;
+		break;
+	case LightingMode::Radiance:
+		contribution = incidentRadiance;
+		break;
+	case LightingMode::BRDF:
+		contribution = material.Shade(closestHit.normal, sample.direction, -viewRay.direction);
+		break;
+	}
+	return true;
+}
+
+bool Renderer::IsOccluded(const RenderScene* pRenderScene, const HitRecord& closestHit, const LightUtils::LightSample& sample) const
+{
+	if (!m_ShadowsEnabled)
+		return false;
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+	const Ray lray{ closestHit.origin, sample.direction, 0.1f, sample.distance };
+	return pRenderScene->DoesHit(lray);
+}
 
+void Renderer::SetTileSize(int tileSize)
+{
+	m_TileSize = std::max(1, tileSize);
+	CreateTiles();
+}
+
+void Renderer::CycleTileSize()
+{
+	SetTileSize(m_TileSize >= 64 ? 8 : m_TileSize * 2);
+	std::cout << "Tile size: " << m_TileSize << "x" << m_TileSize << std::endl;
+}
+
+void Renderer::SetThreadCount(uint32_t numThreads, bool pinThreads)
+{
+	//Destroy the old pool first so its threads are joined before new ones are spawned
+	m_pThreadPool.reset();
+	m_pThreadPool = std::make_unique<ThreadPool>(numThreads, pinThreads);
+}
+
+uint32_t Renderer::GetThreadCount() const
+{
+	return m_ThreadingMode == ThreadingMode::ThreadPool ? m_pThreadPool->GetThreadCount() : 1;
+}
+
+void Renderer::ToggleMultithreading()
+{
+	m_ThreadingMode = m_ThreadingMode == ThreadingMode::ThreadPool ? ThreadingMode::SingleThreaded : ThreadingMode::ThreadPool;
+	std::cout << "Render threads: " << GetThreadCount() << std::endl;
+}
+
+void Renderer::ToggleAccumulation()
+{
+	m_AccumulationEnabled = !m_AccumulationEnabled;
+	ResetAccumulation();
+	std::cout << "Accumulation: " << (m_AccumulationEnabled ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::ToggleSamplingMode()
+{
+	m_SamplingMode = m_SamplingMode == SamplingMode::Random ? SamplingMode::Halton : SamplingMode::Random;
+	ResetAccumulation();
+	std::cout << "Sampling: " << (m_SamplingMode == SamplingMode::Random ? "PCG32" : "Halton") << std::endl;
+}
+
+void Renderer::SetDirectLightingMode(DirectLightingMode mode)
+{
+	m_DirectLightingMode = mode;
+	ResetAccumulation();
+}
+
+void Renderer::CycleDirectLightingMode()
+{
+	switch (m_DirectLightingMode)
+	{
+	case DirectLightingMode::AllLights:
+		SetDirectLightingMode(DirectLightingMode::LightTree);
+		std::cout << "Direct lighting: light tree" << std::endl;
+		break;
+	case DirectLightingMode::LightTree:
+		SetDirectLightingMode(DirectLightingMode::Reservoir);
+		std::cout << "Direct lighting: reservoirs (ReSTIR)" << std::endl;
+		break;
+	case DirectLightingMode::Reservoir:
+		SetDirectLightingMode(DirectLightingMode::AllLights);
+		std::cout << "Direct lighting: all lights" << std::endl;
+		break;
+	}
+}
+
+void Renderer::ToggleAdaptiveShadows()
+{
+	m_AdaptiveShadows.enabled = !m_AdaptiveShadows.enabled;
+	ResetAccumulation();
+	std::cout << "Adaptive shadows: " << (m_AdaptiveShadows.enabled ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::ToggleWavefront()
+{
+	m_WavefrontEnabled = !m_WavefrontEnabled;
+	std::cout << "Wavefront rendering: " << (m_WavefrontEnabled ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::TogglePacketTracing()
+{
+	m_PacketTracingEnabled = !m_PacketTracingEnabled;
+	std::cout << "Packet tracing: " << (m_PacketTracingEnabled ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::CreateTiles()
+{
+	const int numTilesX{ (m_Width + m_TileSize - 1) / m_TileSize };
+	const int numTilesY{ (m_Height + m_TileSize - 1) / m_TileSize };
+
+	//Interleaves the bits of x and y, walking tiles along a Z-curve keeps consecutive tiles close together on screen
+	const auto mortonCode = [](uint32_t x, uint32_t y)
+		{
+			uint32_t code{ 0 };
+			for (uint32_t bit{ 0 }; bit < 16; ++bit)
+			{
+				code |= ((x >> bit) & 1u) << (2 * bit);
+				code |= ((y >> bit) & 1u) << (2 * bit + 1);
+			}
+			return code;
+		};
+
+	std::vector<std::pair<uint32_t, Tile>> sortedTiles{};
+	sortedTiles.reserve(static_cast<size_t>(numTilesX) * numTilesY);
+	for (int tileY{ 0 }; tileY < numTilesY; ++tileY)
+	{
+		for (int tileX{ 0 }; tileX < numTilesX; ++tileX)
+		{
+			Tile tile{};
+			tile.x = tileX * m_TileSize;
+			tile.y = tileY * m_TileSize;
+			tile.width = std::min(m_TileSize, m_Width - tile.x);
+			tile.height = std::min(m_TileSize, m_Height - tile.y);
+
+			sortedTiles.emplace_back(mortonCode(tileX, tileY), tile);
+		}
+	}
+
+	std::sort(sortedTiles.begin(), sortedTiles.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	m_Tiles.clear();
+	for (const auto& sortedTile : sortedTiles)
+	{
+		m_Tiles.push_back(sortedTile.second);
+	}
+	m_TileRenderTimes.assign(m_Tiles.size(), 0.f);
 }
 
 bool Renderer::SaveBufferToImage() const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	return SaveBufferToImage("RayTracing_Buffer.bmp");
+}
+
+bool Renderer::SaveBufferToImage(const std::string& filePath) const
+{
+	return SDL_SaveBMP(m_pBuffer, filePath.c_str());
 }
 
 void dae::Renderer::CycleLightingMode()
@@ -292,4 +848,5 @@ void dae::Renderer::CycleLightingMode()
 		m_CurrentLightingMode = LightingMode::ObservedArea;
 		break;
 	}
+	ResetAccumulation();
 }
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 
-#include "Camera.h"
 #include "DataTypes.h"
-#include "Material.h"
+#include "LightReservoir.h"
+#include "MaterialData.h"
+#include "ThreadPool.h"
+#include "WavefrontQueues.h"
 
 struct SDL_Window;
 struct SDL_Surface;
@@ -12,26 +17,119 @@ struct SDL_Surface;
 namespace dae
 {
 	class Scene;
+	class RenderScene;
+	class PCG32;
+
+	namespace LightUtils
+	{
+		struct LightSample;
+	}
 
 	class Renderer final
 	{
 	public:
 		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		//Headless renderer, renders into its own framebuffer instead of a window surface
+		//Check HasFramebuffer afterwards, SDL can fail to allocate it for large sizes
+		Renderer(int width, int height);
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
+		void Render(Scene* pScene);
+		bool HasFramebuffer() const { return m_pBuffer != nullptr; }
+
+		//Screen-space block of pixels rendered as one unit of work
+		struct Tile
+		{
+			int x{};
+			int y{};
+			int width{};
+			int height{};
+		};
+
+		//Primary rays of the current frame, the camera basis and field of view are folded into per-pixel steps once per frame
+		struct ViewRayGenerator
+		{
+			Vector3 origin{};
+			Vector3 firstDirection{}; //Through the center of pixel (0, 0), not normalized
+			Vector3 stepX{}; //Direction change from one pixel to the next one on its right
+			Vector3 stepY{}; //Direction change from one pixel to the one below it
+
+			Vector3 GetDirection(int px, int py) const
+			{
+				return Vector3{
+					firstDirection.x + px * stepX.x + py * stepY.x,
+					firstDirection.y + px * stepX.y + py * stepY.y,
+					firstDirection.z + px * stepX.z + py * stepY.z };
+			}
+
+			Ray Generate(int px, int py) const { return Ray{ origin, GetDirection(px, py) }; }
+		};
 
-		void RenderPixel(const Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const;
+		void RenderPixel(const RenderScene* pRenderScene, uint32_t pixelIndex, const ViewRayGenerator& viewRays, const std::vector<Light>& lights, const std::vector<MaterialData>& materials);
+		//Traces the primary rays of the 2x2 pixel block at (px, py) as one SSE packet, pixels outside the tile are skipped
+		void RenderPacket(const RenderScene* pRenderScene, int px, int py, const Tile& tile, const ViewRayGenerator& viewRayGenerator, const std::vector<Light>& lights, const std::vector<MaterialData>& materials);
 
 		bool SaveBufferToImage() const;
+		bool SaveBufferToImage(const std::string& filePath) const;
 
 		void CycleLightingMode();
-		void TogglShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; }
+		void TogglShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; ResetAccumulation(); }
+
+		//Successive frames of a static view are averaged in a linear float buffer, which converges with few samples per frame
+		void ToggleAccumulation();
+		void ResetAccumulation() { m_AccumulatedFrames = 0; }
+		void ToggleSamplingMode();
+		void TogglePacketTracing();
+		//Renders tiles stage by stage (generate, intersect, shade, shadow) through per-thread queues instead of pixel by pixel
+		void ToggleWavefront();
+
+		enum class DirectLightingMode
+		{
+			AllLights, //Every light is shaded at every hit
+			LightTree, //A few lights per hit, picked from the light tree in proportion to their estimated contribution
+			Reservoir //ReSTIR, one light sample per pixel resampled from new candidates and last frame's reservoirs
+		};
+
+		void SetDirectLightingMode(DirectLightingMode mode);
+		void CycleDirectLightingMode();
+
+		//Area light shadows on the first frame after a reset start with a few shadow rays per light and only trace the rest where those disagree
+		//Fully lit points take the remaining light samples without shadow rays, points in the umbra stop right away
+		struct AdaptiveShadowSettings
+		{
+			bool enabled{ true };
+			int initialSamples{ 2 }; //Shadow rays every point traces before deciding
+			int maxSamples{ 12 }; //Light samples per light, replaces AreaLightSamplesSingleFrame while enabled
+			float penumbraThreshold{ 0.f }; //Largest fraction of initial shadow rays allowed to disagree with the rest before refining
+		};
+
+		void SetAdaptiveShadowSettings(const AdaptiveShadowSettings& settings) { m_AdaptiveShadows = settings; ResetAccumulation(); }
+		const AdaptiveShadowSettings& GetAdaptiveShadowSettings() const { return m_AdaptiveShadows; }
+		void ToggleAdaptiveShadows();
+		uint32_t GetAccumulatedFrames() const { return m_AccumulatedFrames; }
+
+		void SetTileSize(int tileSize);
+		int GetTileSize() const { return m_TileSize; }
+		void CycleTileSize();
+
+		//Tiles in dispatch order, with the time in milliseconds each one took during the last frame
+		const std::vector<Tile>& GetTiles() const { return m_Tiles; }
+		const std::vector<float>& GetTileRenderTimes() const { return m_TileRenderTimes; }
+
+		/**
+		 * \brief Recreates the worker threads used to render tiles
+		 * \param numThreads total number of render threads (0 = hardware concurrency)
+		 * \param pinThreads pin every worker thread to its own core
+		 */
+		void SetThreadCount(uint32_t numThreads, bool pinThreads = false);
+		uint32_t GetThreadCount() const;
+		ThreadPool* GetThreadPool() const { return m_pThreadPool.get(); }
+		void ToggleMultithreading();
 
 	private:
 		enum class LightingMode
@@ -45,6 +143,27 @@ namespace dae
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
 		bool m_ShadowsEnabled{ true };
 
+		enum class SamplingMode
+		{
+			Random, //PCG32 seeded per pixel and frame
+			Halton //Low-discrepancy sequence continued across accumulated frames
+		};
+
+		SamplingMode m_SamplingMode{ SamplingMode::Random };
+		DirectLightingMode m_DirectLightingMode{ DirectLightingMode::AllLights };
+		AdaptiveShadowSettings m_AdaptiveShadows{};
+		bool m_PacketTracingEnabled{ true };
+		bool m_WavefrontEnabled{ false };
+
+		enum class ThreadingMode
+		{
+			SingleThreaded,
+			ThreadPool
+		};
+
+		ThreadingMode m_ThreadingMode{ ThreadingMode::ThreadPool };
+		std::unique_ptr<ThreadPool> m_pThreadPool{};
+
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pBuffer{};
@@ -52,5 +171,62 @@ namespace dae
 
 		int m_Width{};
 		int m_Height{};
+
+		//Linear HDR radiance summed over every frame since the last reset, only tonemapped when written to the surface
+		std::vector<ColorRGB> m_AccumulationBuffer{};
+		uint32_t m_AccumulatedFrames{ 0 };
+		bool m_AccumulationEnabled{ true };
+		const Scene* m_pAccumulatedScene{ nullptr };
+		uint32_t m_AccumulatedSceneVersion{ 0 };
+
+		//The first frame after a reset takes the single-frame budgets, animated scenes reset every frame and never get further
+		bool IsAccumulating() const { return m_AccumulatedFrames > 1; }
+
+		//Samples per area light per frame, accumulation spreads the noise reduction over multiple frames
+		//Samples are stratified over the part of the light seen from the hit, 8 of them are less noisy than 32 unstratified ones over the whole light
+		static constexpr int AreaLightSamplesAccumulated{ 2 };
+		static constexpr int AreaLightSamplesSingleFrame{ 8 };
+
+		//Lights picked per hit in DirectLightingMode::LightTree
+		static constexpr int LightTreeSamplesAccumulated{ 1 };
+		static constexpr int LightTreeSamplesSingleFrame{ 4 };
+
+		//One reservoir per pixel for DirectLightingMode::Reservoir, each frame reads the previous one and writes the current one
+		std::vector<LightReservoir> m_Reservoirs{};
+		std::vector<LightReservoir> m_PreviousReservoirs{};
+		uint32_t m_FrameIndex{ 0 }; //Never reset, unlike m_AccumulatedFrames
+
+		static constexpr int ReservoirCandidates{ 8 }; //Light tree samples streamed into every reservoir per frame
+		static constexpr int ReservoirSpatialNeighbours{ 2 };
+		static constexpr float ReservoirSpatialRadius{ 16.f }; //In pixels
+		static constexpr int ReservoirMaxHistory{ 20 }; //Cap on reused sample counts, in multiples of ReservoirCandidates
+
+		int m_TileSize{ 32 };
+		std::vector<Tile> m_Tiles{};
+		std::vector<float> m_TileRenderTimes{};
+
+		void CreateTiles();
+		ViewRayGenerator CreateViewRayGenerator(float fov, float aspectRatio, const Matrix& cameraToWorld) const;
+		void ShadePixel(const RenderScene* pRenderScene, uint32_t pixelIndex, const Ray& viewRay, const HitRecord& closestHit, const std::vector<Light>& lights, const std::vector<MaterialData>& materials);
+		//Contribution of a single light at the hit point, area lights are sampled and shadow tested multiple times
+		ColorRGB ShadeLight(const RenderScene* pRenderScene, const Light& light, const Ray& viewRay, const HitRecord& closestHit, const MaterialData& material, PCG32& rng) const;
+		//Direct light from the pixel's reservoir, updates it with new candidates and the reservoirs of the previous frame
+		ColorRGB ShadeReservoir(const RenderScene* pRenderScene, uint32_t pixelIndex, const Ray& viewRay, const HitRecord& closestHit, const std::vector<Light>& lights, const MaterialData& material);
+		//Unshadowed contribution of a light sample for the current lighting mode, false when the sample is below the surface
+		bool EvaluateLightSample(const LightUtils::LightSample& sample, const HitRecord& closestHit, const Ray& viewRay, const MaterialData& material, ColorRGB& contribution) const;
+		bool IsOccluded(const RenderScene* pRenderScene, const HitRecord& closestHit, const LightUtils::LightSample& sample) const;
+		void RenderTile(const RenderScene* pRenderScene, uint32_t tileIndex, const ViewRayGenerator& viewRays, const std::vector<Light>& lights, const std::vector<MaterialData>& materials);
+		void WritePixel(uint32_t pixelIndex, const ColorRGB& finalColor);
+		//Shared by ShadeLight and the wavefront shading stage, index is the sample's position in a stratified set of count samples
+		void GetAreaLightSampleCoordinates(int index, int first, int count, int numSamples, float offsetU, float offsetV, PCG32& rng, float& u, float& v) const;
+
+		//Wavefront stages, every one runs over the whole tile before the next one starts
+		void RenderTileWavefront(const RenderScene* pRenderScene, const Tile& tile, const ViewRayGenerator& viewRays, const std::vector<Light>& lights, const std::vector<MaterialData>& materials);
+		void GenerateRays(const Tile& tile, const ViewRayGenerator& viewRays, WavefrontQueues& queues) const;
+		void IntersectRays(const RenderScene* pRenderScene, const Vector3& origin, WavefrontQueues& queues);
+		void ShadeHits(const RenderScene* pRenderScene, const Vector3& origin, const std::vector<Light>& lights, const std::vector<MaterialData>& materials, WavefrontQueues& queues);
+		//Queues a shadow ray for every light sample above the surface, weight scales the contribution they carry
+		void QueueLightSamples(const Light& light, const Ray& viewRay, const HitRecord& closestHit, const MaterialData& material, float weight, uint32_t slot, PCG32& rng, WavefrontQueues& queues) const;
+		void TraceShadowRays(const RenderScene* pRenderScene, WavefrontQueues& queues) const;
 	};
 }
@@ -15,7 +15,10 @@ namespace dae {
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
+		m_TriangleMeshInstances.reserve(32);
 		m_Lights.reserve(32);
+
+		m_RenderScene.AddMaterial(*m_Materials.front());
 	}
 
 	Scene::~Scene()
@@ -29,87 +32,32 @@ namespace dae {
 		m_Materials.clear();
 	}
 
-	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
+	void Scene::Commit()
 	{
-		HitRecord hitTest;
-
-		for (auto& sphere : m_SphereGeometries)
-		{
-			if (GeometryUtils::HitTest_Sphere(sphere, ray, hitTest))
-			{
-				if (hitTest.t < closestHit.t)
-				{
-					closestHit = hitTest;
-				}
-			}
-		}
-		for (auto& plane : m_PlaneGeometries)
-		{
-			if (GeometryUtils::HitTest_Plane(plane, ray, hitTest))
-			{
-				if (hitTest.t < closestHit.t)
-				{
-					closestHit = hitTest;
-				}
-			}
-		}
-		//TEMP
-		//	for (auto& triangle : m_Triangles)
-		//	{
-		//		if (GeometryUtils::HitTest_Triangle(triangle, ray, hitTest))
-		//		{
-		//			if (hitTest.t < closestHit.t)
-		//			{
-		//				closestHit = hitTest;
-		//			}
-		//		}
-		//	}
-
-		for (auto& triangleMesh : m_TriangleMeshGeometries)
-		{
-			if (GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray, hitTest))
-			{
-				if (hitTest.t < closestHit.t)
-				{
-					closestHit = hitTest;
-				}
-			}
-		}
-	}
-
-	bool Scene::DoesHit(const Ray& ray) const
-	{
-		for (auto& sphere : m_SphereGeometries)
-		{
-			if (GeometryUtils::HitTest_Sphere(sphere, ray))
-			{
-				return true;
-			}
-		}
-		for (auto& plane : m_PlaneGeometries)
-		{
-			if (GeometryUtils::HitTest_Plane(plane, ray))
-			{
-				return true;
-			}
-		}
-		//TEMP
-		//	for (auto& triangle : m_Triangles)
-		//	{
-		//		if (GeometryUtils::HitTest_Triangle(triangle, ray))
-		//		{
-		//			return true;
-		//		}
-		//	}
-		for (auto& triangleMesh : m_TriangleMeshGeometries)
-		{
-			if (GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray))
-			{
-				return true;
-			}
-		}
-		
-		return false;
+		//Static scenes never change after the first commit, animated ones usually only move meshes
+		if (m_Version == m_CommittedVersion)
+			return;
+
+		if (m_ArePlanesDirty)
+			m_RenderScene.BuildPlanes(m_PlaneGeometries);
+		if (m_AreSpheresDirty)
+			m_RenderScene.BuildSpheres(m_SphereGeometries);
+
+		//New sphere blocks or meshes change what the leaves of the top-level BVH hold, moved meshes only change their bounds
+		if (m_AreSpheresDirty || m_AreMeshesAdded)
+			m_RenderScene.BuildObjects(m_TriangleMeshGeometries, m_TriangleMeshInstances);
+		else if (m_HaveMeshesMoved)
+			m_RenderScene.UpdateMeshTransforms(m_TriangleMeshInstances);
+
+		if (m_AreLightsDirty)
+			m_RenderScene.BuildLights(m_Lights);
+
+		m_ArePlanesDirty = false;
+		m_AreSpheresDirty = false;
+		m_AreMeshesAdded = false;
+		m_HaveMeshesMoved = false;
+		m_AreLightsDirty = false;
+		m_CommittedVersion = m_Version;
 	}
 
 #pragma region Scene Helpers
@@ -120,6 +68,7 @@ namespace dae {
 		s.radius = radius;
 		s.materialIndex = materialIndex;
 
+		MarkSpheresChanged();
 		m_SphereGeometries.emplace_back(s);
 		return &m_SphereGeometries.back();
 	}
@@ -131,6 +80,7 @@ namespace dae {
 		p.normal = normal;
 		p.materialIndex = materialIndex;
 
+		MarkPlanesChanged();
 		m_PlaneGeometries.emplace_back(p);
 		return &m_PlaneGeometries.back();
 	}
@@ -141,10 +91,30 @@ namespace dae {
 		m.cullMode = cullMode;
 		m.materialIndex = materialIndex;
 
+		MarkMeshesAdded();
 		m_TriangleMeshGeometries.emplace_back(m);
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	TriangleMesh* Scene::AddSharedTriangleMesh()
+	{
+		m_SharedTriangleMeshes.emplace_back();
+		return &m_SharedTriangleMeshes.back();
+	}
+
+	TriangleMeshInstance* Scene::AddTriangleMeshInstance(const TriangleMesh* pMesh, TriangleCullMode cullMode, unsigned char materialIndex)
+	{
+		TriangleMeshInstance instance{};
+		instance.pMesh = pMesh;
+		instance.cullMode = cullMode;
+		instance.materialIndex = materialIndex;
+		instance.UpdateTransforms();
+
+		MarkMeshesAdded();
+		m_TriangleMeshInstances.emplace_back(instance);
+		return &m_TriangleMeshInstances.back();
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -153,6 +123,7 @@ namespace dae {
 		l.color = color;
 		l.type = LightType::Point;
 
+		MarkLightsChanged();
 		m_Lights.emplace_back(l);
 		return &m_Lights.back();
 	}
@@ -165,6 +136,7 @@ namespace dae {
 		l.color = color;
 		l.type = LightType::Directional;
 
+		MarkLightsChanged();
 		m_Lights.emplace_back(l);
 		return &m_Lights.back();
 	}
@@ -183,6 +155,7 @@ namespace dae {
 		l.width = width;
 		l.height = height;
 
+		MarkLightsChanged();
 		m_Lights.emplace_back(l);
 		return &m_Lights.back();
 	}
@@ -201,6 +174,7 @@ namespace dae {
 		l.intensity = intensity;
 		l.height = radius;
 
+		MarkLightsChanged();
 		m_Lights.emplace_back(l);
 		return &m_Lights.back();
 	}
@@ -219,6 +193,7 @@ namespace dae {
 		l.intensity = intensity;
 		l.height = radius;
 
+		MarkLightsChanged();
 		m_Lights.emplace_back(l);
 		return &m_Lights.back();
 	}
@@ -226,6 +201,7 @@ namespace dae {
 	unsigned char Scene::AddMaterial(Material* pMaterial)
 	{
 		m_Materials.push_back(pMaterial);
+		m_RenderScene.AddMaterial(*pMaterial);
 		return static_cast<unsigned char>(m_Materials.size() - 1);
 	}
 #pragma endregion
@@ -392,12 +368,10 @@ namespace dae {
 		//	pMesh->Translate({0.f, 1.5f, 0.f});
 		//	pMesh->UpdateTransforms();
 
-		pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/simple_cube.obj",
-			pMesh->positions,
-			pMesh->normals,
-			pMesh->indices);
+		TriangleMesh* pCube = AddSharedTriangleMesh();
+		Utils::LoadOBJMesh("Resources/simple_cube.obj", *pCube, m_pThreadPool);
 
+		pMesh = AddTriangleMeshInstance(pCube, TriangleCullMode::BackFaceCulling, matLambert_White);
 		pMesh->Scale({ .7f, .7f, .7f });
 		pMesh->Translate({ 0.f, 1.f, 0.f });
 
@@ -414,6 +388,7 @@ namespace dae {
 
 		pMesh->RotateY(PI_DIV_2 *pTimer->GetTotal());
 		pMesh->UpdateTransforms();
+		MarkMeshesMoved();
 	}
 
 	void SceneW4_ReferenceScene::Initialize()
@@ -449,22 +424,20 @@ namespace dae {
 		//Triangles
 		const Triangle baseTriangle = { Vector3(-.75f,1.5f,0.f), Vector3(.75f, 0.f,0.f), Vector3(-.75f,0.f,0.f) };
 
-		m_Meshes[0] = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		m_Meshes[0]->AppendTriangle(baseTriangle, true);
+		//All three share the same triangle, only their transform and cull mode differ
+		TriangleMesh* pTriangle = AddSharedTriangleMesh();
+		pTriangle->AppendTriangle(baseTriangle);
+
+		m_Meshes[0] = AddTriangleMeshInstance(pTriangle, TriangleCullMode::BackFaceCulling, matLambert_White);
 		m_Meshes[0]->Translate({ -1.75f, 4.5f, 0.f });
-		m_Meshes[0]->UpdateAABB();
 		m_Meshes[0]->UpdateTransforms();
 
-		m_Meshes[1] = AddTriangleMesh(TriangleCullMode::FrontFaceCulling, matLambert_White);
-		m_Meshes[1]->AppendTriangle(baseTriangle, true);
+		m_Meshes[1] = AddTriangleMeshInstance(pTriangle, TriangleCullMode::FrontFaceCulling, matLambert_White);
 		m_Meshes[1]->Translate({ 0.f, 4.5f, 0.f });
-		m_Meshes[1]->UpdateAABB();
 		m_Meshes[1]->UpdateTransforms();
 		
-		m_Meshes[2] = AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_White);
-		m_Meshes[2]->AppendTriangle(baseTriangle, true);
+		m_Meshes[2] = AddTriangleMeshInstance(pTriangle, TriangleCullMode::NoCulling, matLambert_White);
 		m_Meshes[2]->Translate({ 1.75f, 4.5f, 0.f });
-		m_Meshes[2]->UpdateAABB();
 		m_Meshes[2]->UpdateTransforms();
 
 		//Lights
@@ -482,6 +455,7 @@ namespace dae {
 			m->RotateY(yawAngle);
 			m->UpdateTransforms();
 		}
+		MarkMeshesMoved();
 
 	}
 
@@ -500,15 +474,12 @@ namespace dae {
 		AddPlane({ 5.f, 0.f, 0.f }, { -1.f, 0.f, 0.f }, matLambert_GrayBlue); //RIGHT
 		AddPlane({ -5.f, 0.f, 0.f }, { 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
 
-		pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/lowpoly_bunny.obj",
-			pMesh->positions,
-			pMesh->normals,
-			pMesh->indices);
+		TriangleMesh* pBunny = AddSharedTriangleMesh();
+		Utils::LoadOBJMesh("Resources/lowpoly_bunny.obj", *pBunny, m_pThreadPool);
 
+		//Rotating the instance only updates its matrices, the vertices and BVH stay in object space
+		pMesh = AddTriangleMeshInstance(pBunny, TriangleCullMode::BackFaceCulling, matLambert_White);
 		pMesh->Scale({ 2.f, 2.f, 2.f });
-
-		pMesh->UpdateAABB();
 		pMesh->UpdateTransforms();
 
 		//Lights
@@ -523,6 +494,7 @@ namespace dae {
 
 		pMesh->RotateY(PI_DIV_2 * pTimer->GetTotal());
 		pMesh->UpdateTransforms();
+		MarkMeshesMoved();
 	}
 #pragma endregion
 #pragma region SCENE EXTRA
@@ -585,22 +557,20 @@ namespace dae {
 		//Triangles
 		const Triangle baseTriangle = { Vector3(-.75f,1.5f,0.f), Vector3(.75f, 0.f,0.f), Vector3(-.75f,0.f,0.f) };
 
-		m_pMeshes[0] = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		m_pMeshes[0]->AppendTriangle(baseTriangle, true);
+		//All three share the same triangle, only their transform and cull mode differ
+		TriangleMesh* pTriangle = AddSharedTriangleMesh();
+		pTriangle->AppendTriangle(baseTriangle);
+
+		m_pMeshes[0] = AddTriangleMeshInstance(pTriangle, TriangleCullMode::BackFaceCulling, matLambert_White);
 		m_pMeshes[0]->Translate({ -1.75f, 4.5f, 0.f });
-		m_pMeshes[0]->UpdateAABB();
 		m_pMeshes[0]->UpdateTransforms();
 		  
-		m_pMeshes[1] = AddTriangleMesh(TriangleCullMode::FrontFaceCulling, matLambert_White);
-		m_pMeshes[1]->AppendTriangle(baseTriangle, true);
+		m_pMeshes[1] = AddTriangleMeshInstance(pTriangle, TriangleCullMode::FrontFaceCulling, matLambert_White);
 		m_pMeshes[1]->Translate({ 0.f, 4.5f, 0.f });
-		m_pMeshes[1]->UpdateAABB();
 		m_pMeshes[1]->UpdateTransforms();
 		  
-		m_pMeshes[2] = AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_White);
-		m_pMeshes[2]->AppendTriangle(baseTriangle, true);
+		m_pMeshes[2] = AddTriangleMeshInstance(pTriangle, TriangleCullMode::NoCulling, matLambert_White);
 		m_pMeshes[2]->Translate({ 1.75f, 4.5f, 0.f });
-		m_pMeshes[2]->UpdateAABB();
 		m_pMeshes[2]->UpdateTransforms();
 
 		//Lights
@@ -626,6 +596,27 @@ namespace dae {
 			m->RotateY(yawAngle);
 			m->UpdateTransforms();
 		}
+		MarkMeshesMoved();
+	}
+
+	void Scene_Extra_GrazingLight::Initialize()
+	{
+		//Looks down at the floor between the camera and the sphere
+		m_Camera.origin = { 0.f, 6.f, -4.f };
+		m_Camera.totalPitch = -.6f;
+		m_Camera.ChangeFOV(60.f);
+
+		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, .57f, .57f }, 1.f));
+		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+
+		//Plane
+		AddPlane({ 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, matLambert_White); //BOTTOM
+
+		//Sphere, its shadow on the floor stretches towards the camera
+		AddSphere({ 0.f, 1.f, 3.f }, 1.f, matLambert_GrayBlue);
+
+		//Light, only its top edge rises above the floor
+		AddRectAreaLight({ 0.f, -.7f, 7.f }, 400.f, { 0.f, 0.f, -1.f }, { 0.f, 1.f, 0.f }, 6.f, 2.f, colors::White);
 	}
 #pragma endregion
 }
@@ -1,15 +1,18 @@
 #pragma once
+#include <deque>
 #include <string>
 #include <vector>
 
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "RenderScene.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
+	class ThreadPool;
 	class Material;
 	struct Plane;
 	struct Sphere;
@@ -34,13 +37,23 @@ namespace dae
 		}
 
 		Camera& GetCamera() { return m_Camera; }
-		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
-		bool DoesHit(const Ray& ray) const;
+
+		//Lets mesh updates share the worker threads of the renderer, set before Initialize, the pool must outlive the scene updates
+		void SetThreadPool(ThreadPool* pThreadPool) { m_pThreadPool = pThreadPool; }
+
+		//Increases every time geometry or lights changed, lets the renderer know its accumulated frames are stale
+		uint32_t GetVersion() const { return m_Version; }
+
+		/**
+		 * \brief Bakes the parts of the scene that changed since the last call into the render representation, call once per frame after Update
+		 */
+		void Commit();
+		const RenderScene& GetRenderScene() const { return m_RenderScene; }
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const std::vector<Material*>& GetMaterials() const { return m_Materials; }
 
 	protected:
 		std::string	sceneName;
@@ -48,6 +61,8 @@ namespace dae
 		std::vector<Plane> m_PlaneGeometries{};
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::deque<TriangleMesh> m_SharedTriangleMeshes{}; //Only rendered through instances, a deque keeps their pointers valid while more meshes are added
+		std::vector<TriangleMeshInstance> m_TriangleMeshInstances{};
 		std::vector<Light> m_Lights{};
 		std::vector<Material*> m_Materials{};
 
@@ -55,10 +70,20 @@ namespace dae
 		//std::vector<Triangle> m_Triangles{};
 
 		Camera m_Camera{};
+		ThreadPool* m_pThreadPool{ nullptr };
+
+		//Call after changing objects through the pointers the Add helpers return, Commit only rebuilds what was marked
+		//Moving meshes or instances keeps the top-level BVH and only refits it, planes and spheres are re-baked when marked themselves
+		void MarkMeshesMoved() { ++m_Version; m_HaveMeshesMoved = true; }
+		void MarkPlanesChanged() { ++m_Version; m_ArePlanesDirty = true; }
+		void MarkSpheresChanged() { ++m_Version; m_AreSpheresDirty = true; }
+		void MarkLightsChanged() { ++m_Version; m_AreLightsDirty = true; }
 
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
 		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		TriangleMesh* AddSharedTriangleMesh();
+		TriangleMeshInstance* AddTriangleMeshInstance(const TriangleMesh* pMesh, TriangleCullMode cullMode, unsigned char materialIndex = 0);
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
@@ -68,6 +93,18 @@ namespace dae
 			const Vector3& up, float radius, const ColorRGB& color);
 		dae::Light* AddSphereAreaLight(const Vector3& origin, float intensity, const Vector3& normal, const Vector3& up, float radius, const ColorRGB& color);
 		unsigned char AddMaterial(Material* pMaterial);
+
+	private:
+		RenderScene m_RenderScene{};
+		uint32_t m_Version{ 0 };
+		uint32_t m_CommittedVersion{ UINT32_MAX }; //Never committed yet
+		bool m_ArePlanesDirty{ true };
+		bool m_AreSpheresDirty{ true };
+		bool m_AreMeshesAdded{ true }; //The top-level BVH needs a new leaf
+		bool m_HaveMeshesMoved{ false };
+		bool m_AreLightsDirty{ true };
+
+		void MarkMeshesAdded() { ++m_Version; m_AreMeshesAdded = true; }
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -146,7 +183,7 @@ namespace dae
 		void Initialize() override;
 		void Update(Timer* pTimer) override;
 	private:
-		TriangleMesh* pMesh{ nullptr };
+		TriangleMeshInstance* pMesh{ nullptr };
 	};
 	//+++++++++++++++++++++++++++++++++++++++++
 	//WEEK 4 Refrence Scene
@@ -164,7 +201,7 @@ namespace dae
 		void Initialize() override;
 		void Update(Timer* pTimer) override;
 	private:
-		TriangleMesh* m_Meshes[3] = {};
+		TriangleMeshInstance* m_Meshes[3] = {};
 	};
 	//+++++++++++++++++++++++++++++++++++++++++
 	//WEEK 4 Bunny Scene
@@ -182,7 +219,7 @@ namespace dae
 		void Initialize() override;
 		void Update(Timer* pTimer) override;
 	private:
-		TriangleMesh* pMesh{ nullptr };
+		TriangleMeshInstance* pMesh{ nullptr };
 	};
 	//+++++++++++++++++++++++++++++++++++++++++
 	//EXTRA Random Scene
@@ -214,6 +251,21 @@ namespace dae
 		void Initialize() override;
 		void Update(Timer* pTimer) override;
 	private:
-		TriangleMesh* m_pMeshes[3] = {};
+		TriangleMeshInstance* m_pMeshes[3] = {};
+	};
+	//Area light that barely rises above the floor, behind a sphere
+	//Many shadow points only see a sliver of the light above their horizon, render it headless to check no light leaks into the shadow
+	class Scene_Extra_GrazingLight final : public Scene
+	{
+	public:
+		Scene_Extra_GrazingLight() = default;
+		~Scene_Extra_GrazingLight() override = default;
+
+		Scene_Extra_GrazingLight(const Scene_Extra_GrazingLight&) = delete;
+		Scene_Extra_GrazingLight(Scene_Extra_GrazingLight&&) noexcept = delete;
+		Scene_Extra_GrazingLight& operator=(const Scene_Extra_GrazingLight&) = delete;
+		Scene_Extra_GrazingLight& operator=(Scene_Extra_GrazingLight&&) noexcept = delete;
+
+		void Initialize() override;
 	};
 }
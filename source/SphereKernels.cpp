@@ -0,0 +1,118 @@
+#include "SphereKernels.h"
+
+#include <immintrin.h>
+
+#include "CpuFeatures.h"
+
+namespace dae
+{
+	namespace
+	{
+		constexpr uint32_t SSEWidth{ 4 };
+
+		__m128 Blend(__m128 mask, __m128 a, __m128 b)
+		{
+			return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+		}
+
+		__m128 Dot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+		}
+
+		//Distance of the first root inside the ray range for four spheres starting at index first
+		//The quadratic uses b = Dot(d, oc) instead of 2 * Dot(d, oc), which cancels the factors 2 and 4 of the textbook form
+		__m128 IntersectBlock(const SphereArraysView& spheres, uint32_t first, const Ray& ray, __m128& isHit)
+		{
+			const __m128 ocX{ _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(spheres.pCenterX + first)) };
+			const __m128 ocY{ _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(spheres.pCenterY + first)) };
+			const __m128 ocZ{ _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(spheres.pCenterZ + first)) };
+			const __m128 directionX{ _mm_set1_ps(ray.direction.x) };
+			const __m128 directionY{ _mm_set1_ps(ray.direction.y) };
+			const __m128 directionZ{ _mm_set1_ps(ray.direction.z) };
+
+			const float a{ ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y + ray.direction.z * ray.direction.z };
+			const __m128 b{ Dot(directionX, directionY, directionZ, ocX, ocY, ocZ) };
+			const __m128 c{ _mm_sub_ps(Dot(ocX, ocY, ocZ, ocX, ocY, ocZ), _mm_load_ps(spheres.pRadiusSquared + first)) };
+			const __m128 discriminant{ _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(_mm_set1_ps(a), c)) };
+
+			const __m128 hasRoots{ _mm_cmpge_ps(discriminant, _mm_setzero_ps()) };
+			if (_mm_movemask_ps(hasRoots) == 0)
+			{
+				isHit = _mm_setzero_ps();
+				return _mm_setzero_ps();
+			}
+
+			const __m128 rayMin{ _mm_set1_ps(ray.min) };
+			const __m128 invA{ _mm_set1_ps(1.f / a) };
+			const __m128 sqrtD{ _mm_sqrt_ps(_mm_max_ps(discriminant, _mm_setzero_ps())) };
+			const __m128 minusB{ _mm_sub_ps(_mm_setzero_ps(), b) };
+			const __m128 tNear{ _mm_mul_ps(_mm_sub_ps(minusB, sqrtD), invA) };
+			const __m128 tFar{ _mm_mul_ps(_mm_add_ps(minusB, sqrtD), invA) };
+			const __m128 t{ Blend(_mm_cmplt_ps(tNear, rayMin), tFar, tNear) };
+
+			isHit = _mm_and_ps(hasRoots, _mm_and_ps(_mm_cmpge_ps(t, rayMin), _mm_cmple_ps(t, _mm_set1_ps(ray.max))));
+			return t;
+		}
+	}
+
+	uint32_t SphereKernels::FindClosest_SSE(const SphereArraysView& spheres, const Ray& ray, float& t)
+	{
+		//Every lane keeps its own closest candidate, the lanes are only compared once at the end
+		__m128 closestT{ _mm_set1_ps(ray.max) };
+		__m128i closestIndex{ _mm_set1_epi32(-1) };
+		__m128i index{ _mm_setr_epi32(0, 1, 2, 3) };
+		const __m128i step{ _mm_set1_epi32(SSEWidth) };
+
+		for (uint32_t first{ 0 }; first < spheres.count; first += SSEWidth, index = _mm_add_epi32(index, step))
+		{
+			__m128 isHit{};
+			const __m128 hitT{ IntersectBlock(spheres, first, ray, isHit) };
+			const __m128 isCloser{ _mm_and_ps(isHit, _mm_cmple_ps(hitT, closestT)) };
+			if (_mm_movemask_ps(isCloser) == 0)
+				continue;
+
+			closestT = Blend(isCloser, hitT, closestT);
+			closestIndex = _mm_castps_si128(Blend(isCloser, _mm_castsi128_ps(index), _mm_castsi128_ps(closestIndex)));
+		}
+
+		alignas(16) float laneT[SSEWidth]{};
+		alignas(16) int32_t laneIndex[SSEWidth]{};
+		_mm_store_ps(laneT, closestT);
+		_mm_store_si128(reinterpret_cast<__m128i*>(laneIndex), closestIndex);
+
+		//On equal distances the sphere with the highest index wins, same as testing them one after the other
+		uint32_t closest{ UINT32_MAX };
+		for (uint32_t lane{ 0 }; lane < SSEWidth; ++lane)
+		{
+			if (laneIndex[lane] < 0)
+				continue;
+
+			if (closest == UINT32_MAX || laneT[lane] < t || (laneT[lane] == t && static_cast<uint32_t>(laneIndex[lane]) > closest))
+			{
+				t = laneT[lane];
+				closest = static_cast<uint32_t>(laneIndex[lane]);
+			}
+		}
+		return closest;
+	}
+
+	bool SphereKernels::DoesHit_SSE(const SphereArraysView& spheres, const Ray& ray)
+	{
+		for (uint32_t first{ 0 }; first < spheres.count; first += SSEWidth)
+		{
+			__m128 isHit{};
+			IntersectBlock(spheres, first, ray, isHit);
+			if (_mm_movemask_ps(isHit) != 0)
+				return true;
+		}
+		return false;
+	}
+
+	const SphereKernels::KernelSet& SphereKernels::Select()
+	{
+		static const KernelSet sse{ FindClosest_SSE, DoesHit_SSE, "SSE" };
+		static const KernelSet avx2{ FindClosest_AVX2, DoesHit_AVX2, "AVX2" };
+		return CpuFeatures::HasAVX2() ? avx2 : sse;
+	}
+}
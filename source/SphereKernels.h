@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Spheres stored as structure of arrays, every array starts on a 64-byte boundary
+	//count is padded to a multiple of SphereKernels::BlockWidth with spheres that can never be hit
+	struct SphereArraysView
+	{
+		const float* pCenterX{ nullptr };
+		const float* pCenterY{ nullptr };
+		const float* pCenterZ{ nullptr };
+		const float* pRadiusSquared{ nullptr };
+		uint32_t count{};
+	};
+
+	//Tests a single ray against all spheres of a SphereArraysView, several spheres per instruction
+	//The render scene runs them on the blocks of spheres the leaves of its top-level BVH reference
+	namespace SphereKernels
+	{
+		//Widest kernel, spheres are grouped into blocks of this size so one AVX2 iteration tests a whole block and no kernel needs a scalar tail loop
+		constexpr uint32_t BlockWidth{ 8 };
+
+		//Returns the index of the closest sphere hit in [ray.min, ray.max] or UINT32_MAX, t is only written on a hit
+		using FindClosestFunction = uint32_t(*)(const SphereArraysView& spheres, const Ray& ray, float& t);
+		//Occlusion only, returns as soon as any sphere is hit in [ray.min, ray.max]
+		using DoesHitFunction = bool(*)(const SphereArraysView& spheres, const Ray& ray);
+
+		struct KernelSet
+		{
+			FindClosestFunction findClosest{ nullptr };
+			DoesHitFunction doesHit{ nullptr };
+			const char* name{ "" };
+		};
+
+		//4 spheres at a time, every x64 CPU supports these
+		uint32_t FindClosest_SSE(const SphereArraysView& spheres, const Ray& ray, float& t);
+		bool DoesHit_SSE(const SphereArraysView& spheres, const Ray& ray);
+
+		//8 spheres at a time, only call these when CpuFeatures::HasAVX2 is true
+		uint32_t FindClosest_AVX2(const SphereArraysView& spheres, const Ray& ray, float& t);
+		bool DoesHit_AVX2(const SphereArraysView& spheres, const Ray& ray);
+
+		/**
+		 * \brief Picks the widest kernels the CPU running the program supports
+		 */
+		const KernelSet& Select();
+	}
+}
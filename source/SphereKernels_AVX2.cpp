@@ -0,0 +1,109 @@
+#include "SphereKernels.h"
+
+#include <immintrin.h>
+
+//This translation unit is the only one compiled with AVX2 enabled (/arch:AVX2)
+//Nothing in here may be called before SphereKernels::Select confirmed the CPU supports it
+//Only plain data is read from the shared headers, an inline function used here could be linked into the rest of the program as its AVX2 copy
+
+namespace dae
+{
+	namespace
+	{
+		constexpr uint32_t AVXWidth{ 8 };
+
+		__m256 Dot(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz)
+		{
+			return _mm256_fmadd_ps(az, bz, _mm256_fmadd_ps(ay, by, _mm256_mul_ps(ax, bx)));
+		}
+
+		//Same math as the SSE kernel, eight spheres starting at index first
+		__m256 IntersectBlock(const SphereArraysView& spheres, uint32_t first, const Ray& ray, __m256& isHit)
+		{
+			const __m256 ocX{ _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(spheres.pCenterX + first)) };
+			const __m256 ocY{ _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(spheres.pCenterY + first)) };
+			const __m256 ocZ{ _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(spheres.pCenterZ + first)) };
+			const __m256 directionX{ _mm256_set1_ps(ray.direction.x) };
+			const __m256 directionY{ _mm256_set1_ps(ray.direction.y) };
+			const __m256 directionZ{ _mm256_set1_ps(ray.direction.z) };
+
+			const float a{ ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y + ray.direction.z * ray.direction.z };
+			const __m256 b{ Dot(directionX, directionY, directionZ, ocX, ocY, ocZ) };
+			const __m256 c{ _mm256_sub_ps(Dot(ocX, ocY, ocZ, ocX, ocY, ocZ), _mm256_load_ps(spheres.pRadiusSquared + first)) };
+			const __m256 discriminant{ _mm256_fnmadd_ps(_mm256_set1_ps(a), c, _mm256_mul_ps(b, b)) };
+
+			const __m256 hasRoots{ _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ) };
+			if (_mm256_movemask_ps(hasRoots) == 0)
+			{
+				isHit = _mm256_setzero_ps();
+				return _mm256_setzero_ps();
+			}
+
+			const __m256 rayMin{ _mm256_set1_ps(ray.min) };
+			const __m256 invA{ _mm256_set1_ps(1.f / a) };
+			const __m256 sqrtD{ _mm256_sqrt_ps(_mm256_max_ps(discriminant, _mm256_setzero_ps())) };
+			const __m256 minusB{ _mm256_sub_ps(_mm256_setzero_ps(), b) };
+			const __m256 tNear{ _mm256_mul_ps(_mm256_sub_ps(minusB, sqrtD), invA) };
+			const __m256 tFar{ _mm256_mul_ps(_mm256_add_ps(minusB, sqrtD), invA) };
+			const __m256 t{ _mm256_blendv_ps(tNear, tFar, _mm256_cmp_ps(tNear, rayMin, _CMP_LT_OQ)) };
+
+			isHit = _mm256_and_ps(hasRoots, _mm256_and_ps(
+				_mm256_cmp_ps(t, rayMin, _CMP_GE_OQ),
+				_mm256_cmp_ps(t, _mm256_set1_ps(ray.max), _CMP_LE_OQ)));
+			return t;
+		}
+	}
+
+	uint32_t SphereKernels::FindClosest_AVX2(const SphereArraysView& spheres, const Ray& ray, float& t)
+	{
+		//Every lane keeps its own closest candidate, the lanes are only compared once at the end
+		__m256 closestT{ _mm256_set1_ps(ray.max) };
+		__m256i closestIndex{ _mm256_set1_epi32(-1) };
+		__m256i index{ _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) };
+		const __m256i step{ _mm256_set1_epi32(AVXWidth) };
+
+		for (uint32_t first{ 0 }; first < spheres.count; first += AVXWidth, index = _mm256_add_epi32(index, step))
+		{
+			__m256 isHit{};
+			const __m256 hitT{ IntersectBlock(spheres, first, ray, isHit) };
+			const __m256 isCloser{ _mm256_and_ps(isHit, _mm256_cmp_ps(hitT, closestT, _CMP_LE_OQ)) };
+			if (_mm256_movemask_ps(isCloser) == 0)
+				continue;
+
+			closestT = _mm256_blendv_ps(closestT, hitT, isCloser);
+			closestIndex = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(closestIndex), _mm256_castsi256_ps(index), isCloser));
+		}
+
+		alignas(32) float laneT[AVXWidth]{};
+		alignas(32) int32_t laneIndex[AVXWidth]{};
+		_mm256_store_ps(laneT, closestT);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(laneIndex), closestIndex);
+
+		//On equal distances the sphere with the highest index wins, same as testing them one after the other
+		uint32_t closest{ UINT32_MAX };
+		for (uint32_t lane{ 0 }; lane < AVXWidth; ++lane)
+		{
+			if (laneIndex[lane] < 0)
+				continue;
+
+			if (closest == UINT32_MAX || laneT[lane] < t || (laneT[lane] == t && static_cast<uint32_t>(laneIndex[lane]) > closest))
+			{
+				t = laneT[lane];
+				closest = static_cast<uint32_t>(laneIndex[lane]);
+			}
+		}
+		return closest;
+	}
+
+	bool SphereKernels::DoesHit_AVX2(const SphereArraysView& spheres, const Ray& ray)
+	{
+		for (uint32_t first{ 0 }; first < spheres.count; first += AVXWidth)
+		{
+			__m256 isHit{};
+			IntersectBlock(spheres, first, ray, isHit);
+			if (_mm256_movemask_ps(isHit) != 0)
+				return true;
+		}
+		return false;
+	}
+}
@@ -0,0 +1,187 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace dae
+{
+	ThreadPool::ThreadPool(uint32_t numThreads, bool pinThreads) :
+		m_IsPinned(pinThreads)
+	{
+		const uint32_t numCores{ std::max(1u, std::thread::hardware_concurrency()) };
+		if (numThreads == 0)
+			numThreads = numCores;
+
+		m_Ranges = std::make_unique<WorkRange[]>(numThreads);
+
+		//The calling thread is participant 0, workers take the remaining slots
+		m_Workers.reserve(numThreads - 1);
+		for (uint32_t participantIndex{ 1 }; participantIndex < numThreads; ++participantIndex)
+		{
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, participantIndex);
+
+			if (pinThreads)
+				PinToCore(m_Workers.back(), participantIndex % numCores);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_IsShuttingDown = true;
+		}
+		m_WakeCondition.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& task)
+	{
+		if (count == 0)
+			return;
+
+		if (m_Workers.empty())
+		{
+			for (uint32_t i{ 0 }; i < count; ++i)
+			{
+				task(i);
+			}
+			return;
+		}
+
+		//Hand every participant an equal contiguous share, stealing balances whatever is left uneven
+		const uint64_t numParticipants{ GetThreadCount() };
+		for (uint64_t participantIndex{ 0 }; participantIndex < numParticipants; ++participantIndex)
+		{
+			const uint32_t begin{ static_cast<uint32_t>(count * participantIndex / numParticipants) };
+			const uint32_t end{ static_cast<uint32_t>(count * (participantIndex + 1) / numParticipants) };
+			m_Ranges[participantIndex].range.store(PackRange(begin, end), std::memory_order_relaxed);
+		}
+		m_pTask = &task;
+
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_ActiveWorkers = static_cast<uint32_t>(m_Workers.size());
+			++m_Generation;
+		}
+		m_WakeCondition.notify_all();
+
+		ExecuteWork(0);
+
+		//Wait for the workers as well, not just the items, so none of them still scans the ranges of this job
+		{
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_DoneCondition.wait(lock, [this] { return m_ActiveWorkers == 0; });
+		}
+		m_pTask = nullptr;
+	}
+
+	void ThreadPool::WorkerLoop(uint32_t participantIndex)
+	{
+		uint64_t lastGeneration{ 0 };
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock{ m_Mutex };
+				m_WakeCondition.wait(lock, [&] { return m_IsShuttingDown || m_Generation != lastGeneration; });
+
+				if (m_IsShuttingDown)
+					return;
+
+				lastGeneration = m_Generation;
+			}
+
+			ExecuteWork(participantIndex);
+
+			{
+				std::lock_guard<std::mutex> lock{ m_Mutex };
+				if (--m_ActiveWorkers == 0)
+					m_DoneCondition.notify_one();
+			}
+		}
+	}
+
+	void ThreadPool::ExecuteWork(uint32_t participantIndex)
+	{
+		const std::function<void(uint32_t)>& task{ *m_pTask };
+
+		do
+		{
+			uint32_t itemIndex{};
+			while (PopItem(participantIndex, itemIndex))
+			{
+				task(itemIndex);
+			}
+		} while (StealWork(participantIndex));
+	}
+
+	bool ThreadPool::PopItem(uint32_t participantIndex, uint32_t& itemIndex)
+	{
+		std::atomic<uint64_t>& ownRange{ m_Ranges[participantIndex].range };
+
+		uint64_t range{ ownRange.load(std::memory_order_acquire) };
+		while (GetBegin(range) < GetEnd(range))
+		{
+			if (ownRange.compare_exchange_weak(range, PackRange(GetBegin(range) + 1, GetEnd(range)), std::memory_order_acq_rel))
+			{
+				itemIndex = GetBegin(range);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ThreadPool::StealWork(uint32_t participantIndex)
+	{
+		const uint32_t numParticipants{ GetThreadCount() };
+
+		//Start at the neighbour so thieves spread out over the victims instead of all hitting participant 0
+		for (uint32_t offset{ 1 }; offset < numParticipants; ++offset)
+		{
+			std::atomic<uint64_t>& victimRange{ m_Ranges[(participantIndex + offset) % numParticipants].range };
+
+			uint64_t range{ victimRange.load(std::memory_order_acquire) };
+			while (GetBegin(range) < GetEnd(range))
+			{
+				//Take the back half, the victim keeps consuming its front half undisturbed
+				const uint32_t begin{ GetBegin(range) };
+				const uint32_t end{ GetEnd(range) };
+				const uint32_t middle{ begin + (end - begin) / 2 };
+
+				if (victimRange.compare_exchange_weak(range, PackRange(begin, middle), std::memory_order_acq_rel))
+				{
+					m_Ranges[participantIndex].range.store(PackRange(middle, end), std::memory_order_release);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void ThreadPool::PinToCore(std::thread& thread, uint32_t core)
+	{
+#if defined(_WIN32)
+		SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{ 1 } << core);
+#elif defined(__linux__)
+		cpu_set_t cpuSet{};
+		CPU_ZERO(&cpuSet);
+		CPU_SET(core, &cpuSet);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuSet);
+#else
+		(void)thread;
+		(void)core;
+#endif
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//Persistent worker threads that split index ranges between them
+	//Every participant owns a range it consumes from the front, idle participants steal the back half of another range
+	class ThreadPool final
+	{
+	public:
+		/**
+		 * \param numThreads total number of threads working on a job, including the calling thread (0 = hardware concurrency)
+		 * \param pinThreads pin every worker thread to its own core
+		 */
+		explicit ThreadPool(uint32_t numThreads = 0, bool pinThreads = false);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		/**
+		 * \brief Runs task(i) for every i in [0, count) and blocks until all of them are finished
+		 * \param count number of work items
+		 * \param task function called once per work item, the calling thread takes part in the work
+		 */
+		void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& task);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+		bool IsPinned() const { return m_IsPinned; }
+
+	private:
+		//Begin in the low 32 bits, end in the high 32 bits, so both can be swapped in a single compare-exchange
+		struct alignas(64) WorkRange
+		{
+			std::atomic<uint64_t> range{};
+		};
+
+		static uint64_t PackRange(uint32_t begin, uint32_t end) { return (static_cast<uint64_t>(end) << 32) | begin; }
+		static uint32_t GetBegin(uint64_t range) { return static_cast<uint32_t>(range); }
+		static uint32_t GetEnd(uint64_t range) { return static_cast<uint32_t>(range >> 32); }
+
+		void WorkerLoop(uint32_t participantIndex);
+		void ExecuteWork(uint32_t participantIndex);
+		bool PopItem(uint32_t participantIndex, uint32_t& itemIndex);
+		bool StealWork(uint32_t participantIndex);
+
+		static void PinToCore(std::thread& thread, uint32_t core);
+
+		std::vector<std::thread> m_Workers{};
+		std::unique_ptr<WorkRange[]> m_Ranges{};
+		const std::function<void(uint32_t)>* m_pTask{ nullptr };
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+		uint64_t m_Generation{ 0 };
+		uint32_t m_ActiveWorkers{ 0 };
+		bool m_IsShuttingDown{ false };
+		bool m_IsPinned{ false };
+	};
+}
@@ -1,5 +1,6 @@
 #include "Timer.h"
 
+#include <cfloat>
 #include <fstream>
 #include <iostream>
 #include <iostream>
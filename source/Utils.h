@@ -1,7 +1,10 @@
 #pragma once
-#include <fstream>
+#include <cmath>
 #include "Math.h"
 #include "DataTypes.h"
+#include "MeshCache.h"
+#include "ObjLoader.h"
+#include "RayPacket.h"
 
 namespace dae
 {
@@ -9,10 +12,9 @@ namespace dae
 	{
 #pragma region Sphere HitTest
 		//SPHERE HIT-TESTS
-		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Distance to the nearest root inside the ray range, t is only written on a hit
+		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, float& t)
 		{
-			//hitRecord.didHit = false;
-
 			const Vector3 rayToSphere{ ray.origin - sphere.origin };
 			const float A{ Vector3::Dot(ray.direction, ray.direction) };
 			const float B{ Vector3::Dot((ray.direction * 2), rayToSphere) };
@@ -25,118 +27,182 @@ namespace dae
 			}
 
 			const float sqrt_d{ sqrt(discriminant) };
-			float t{ (-B - sqrt_d) / (2 * A) };
-			if (t < ray.min)
+			float hitT{ (-B - sqrt_d) / (2 * A) };
+			if (hitT < ray.min)
 			{
-				t = (-B + sqrt_d) / (2 * A);
+				hitT = (-B + sqrt_d) / (2 * A);
 			}
 
-			if (t <= ray.max && t >= ray.min)
+			if (hitT <= ray.max && hitT >= ray.min)
 			{
-				hitRecord.origin = ray.origin + t * ray.direction;
-				hitRecord.t = t;
-				hitRecord.materialIndex = sphere.materialIndex;
-				hitRecord.normal = Vector3{ hitRecord.origin - sphere.origin }.Normalized();
-				hitRecord.didHit = true;
+				t = hitT;
 				return true;
 			}
 			return false;
 		}
 
+		inline void ResolveHit_Sphere(const Sphere& sphere, const Ray& ray, float t, HitRecord& hitRecord)
+		{
+			hitRecord.origin = ray.origin + t * ray.direction;
+			hitRecord.t = t;
+			hitRecord.materialIndex = sphere.materialIndex;
+			hitRecord.normal = Vector3{ hitRecord.origin - sphere.origin }.Normalized();
+			hitRecord.didHit = true;
+		}
+
+		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			float t{};
+			if (!HitTest_Sphere(sphere, ray, t))
+				return false;
+
+			if (!ignoreHitRecord)
+				ResolveHit_Sphere(sphere, ray, t, hitRecord);
+			return true;
+		}
+
+		//Occlusion only, any root inside the ray range is enough and no hit record is built
 		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Sphere(sphere, ray, temp, true);
+			const Vector3 rayToSphere{ ray.origin - sphere.origin };
+			const float A{ Vector3::Dot(ray.direction, ray.direction) };
+			const float B{ Vector3::Dot((ray.direction * 2), rayToSphere) };
+			const float C{ Vector3::Dot(rayToSphere, rayToSphere) - sphere.radius * sphere.radius };
+			const float discriminant{ (B * B) - (4 * A * C) };
+
+			if (discriminant < 0.f)
+				return false;
+
+			const float sqrt_d{ sqrt(discriminant) };
+			const float tNear{ (-B - sqrt_d) / (2 * A) };
+			const float tFar{ (-B + sqrt_d) / (2 * A) };
+
+			return (tNear >= ray.min && tNear <= ray.max) || (tNear < ray.min && tFar >= ray.min && tFar <= ray.max);
 		}
 #pragma endregion
 #pragma region Plane HitTest
 		//PLANE HIT-TESTS
-		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//t is only written on a hit
+		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, float& t)
 		{
-			//hitRecord.didHit = false;
-
-			const float t{ Vector3::Dot((plane.origin - ray.origin), plane.normal) / Vector3::Dot(ray.direction, plane.normal) };
-			if (t > ray.min && t < ray.max && t < hitRecord.t)
+			const float hitT{ Vector3::Dot((plane.origin - ray.origin), plane.normal) / Vector3::Dot(ray.direction, plane.normal) };
+			if (hitT > ray.min && hitT < ray.max)
 			{
-				const Vector3 normal = plane.normal.Normalized();
-				hitRecord.origin = ray.origin + t * ray.direction;
-				hitRecord.t = t;
-				hitRecord.materialIndex = plane.materialIndex;
-				hitRecord.normal = normal;
-				hitRecord.didHit = true;
+				t = hitT;
 				return true;
 			}
 			return false;
 		}
 
+		inline void ResolveHit_Plane(const Plane& plane, const Ray& ray, float t, HitRecord& hitRecord)
+		{
+			hitRecord.origin = ray.origin + t * ray.direction;
+			hitRecord.t = t;
+			hitRecord.materialIndex = plane.materialIndex;
+			hitRecord.normal = plane.normal.Normalized();
+			hitRecord.didHit = true;
+		}
+
+		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			float t{};
+			if (!HitTest_Plane(plane, ray, t) || t >= hitRecord.t)
+				return false;
+
+			if (!ignoreHitRecord)
+				ResolveHit_Plane(plane, ray, t, hitRecord);
+			return true;
+		}
+
+		//Occlusion only
 		inline bool HitTest_Plane(const Plane& plane, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Plane(plane, ray, temp, true);
+			float t{};
+			return HitTest_Plane(plane, ray, t);
 		}
 #pragma endregion
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		/**
+		 * \brief Moller-Trumbore ray/triangle test, only the distance is returned so callers can defer the rest of the hit record
+		 * \param triangle vertex and edges of the triangle
+		 * \param cullMode faces facing the ray are front faces, matching the counter-clockwise winding of the normal
+		 * \param ray ray to test, hits outside [ray.min, ray.max] are rejected
+		 * \param t distance along the ray, only written on a hit
+		 * \param u barycentric weight of v1, only written on a hit
+		 * \param v barycentric weight of v2, only written on a hit
+		 * \return true if the ray hits the triangle within its range
+		 */
+		inline bool HitTest_Triangle(const PrecomputedTriangle& triangle, TriangleCullMode cullMode, const Ray& ray, float& t, float& u, float& v)
 		{
-			const Vector3 a{ triangle.v1 - triangle.v0 };
-			const Vector3 b{ triangle.v2 - triangle.v0 };
+			const Vector3 pVector{ Vector3::Cross(ray.direction, triangle.edge2) };
+			const float determinant{ Vector3::Dot(triangle.edge1, pVector) };
 
-			const Vector3 normal{ Vector3::Cross(a, b).Normalized() };
-			const float dot{ Vector3::Dot(normal, ray.direction) };
-			if (dot == 0) return false;
-
-			switch (triangle.cullMode) {
+			//The determinant is minus the dot of the unnormalized normal and the ray, its sign tells which face is hit
+			switch (cullMode) {
 			case TriangleCullMode::NoCulling:
+				if (determinant == 0.f) return false;
 				break;
 			case TriangleCullMode::BackFaceCulling:
-				if (dot > 0.f) return false;
+				if (determinant <= 0.f) return false;
 				break;
 			case TriangleCullMode::FrontFaceCulling:
-				if (dot < 0.f) return false;
+				if (determinant >= 0.f) return false;
 				break;
 			}
 
-			const Vector3 center{ Vector3{ (Vector3{triangle.v0} + Vector3{triangle.v1} + Vector3{triangle.v2}) * 1/3.f}};
-			const Vector3 L{ center - ray.origin };
+			const float invDeterminant{ 1.f / determinant };
+			const Vector3 tVector{ ray.origin - triangle.v0 };
 
-			const float t{ Vector3::Dot(L, normal) / Vector3::Dot(ray.direction, normal) };
+			const float hitU{ Vector3::Dot(tVector, pVector) * invDeterminant };
+			if (hitU < 0.f || hitU > 1.f)
+				return false;
 
-			if (t < ray.min || t > ray.max)
-			{
+			const Vector3 qVector{ Vector3::Cross(tVector, triangle.edge1) };
+			const float hitV{ Vector3::Dot(ray.direction, qVector) * invDeterminant };
+			if (hitV < 0.f || hitU + hitV > 1.f)
 				return false;
-			}
 
-			const Vector3 p{ ray.origin + t * ray.direction };
-			const Vector3 vertices[3] = { triangle.v0, triangle.v1, triangle.v2 };
-			for (int i = 0; i < 3; ++i) 
-			{
-				const Vector3 edge{ vertices[(i + 1) % 3] - vertices[i] };
-				const Vector3 pointToSide{ p - vertices[i] };
+			const float hitT{ Vector3::Dot(triangle.edge2, qVector) * invDeterminant };
+			if (hitT < ray.min || hitT > ray.max)
+				return false;
 
-				// Calculate the dot product and store it
-				const float dotResult{ Vector3::Dot(normal, Vector3::Cross(edge, pointToSide)) };
+			t = hitT;
+			u = hitU;
+			v = hitV;
+			return true;
+		}
 
-				if (dotResult < 0.f)
-					return false;
-			}
+		inline bool HitTest_Triangle(const PrecomputedTriangle& triangle, TriangleCullMode cullMode, const Ray& ray, float& t)
+		{
+			float u{}, v{};
+			return HitTest_Triangle(triangle, cullMode, ray, t, u, v);
+		}
+
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			const PrecomputedTriangle precomputed{ triangle.v0, triangle.v1, triangle.v2 };
+
+			float t{};
+			if (!HitTest_Triangle(precomputed, triangle.cullMode, ray, t))
+				return false;
 
 			if (!ignoreHitRecord)
 			{
 				hitRecord.origin = ray.origin + t * ray.direction;
 				hitRecord.t = t;
 				hitRecord.materialIndex = triangle.materialIndex;
-				hitRecord.normal = normal;
+				hitRecord.normal = triangle.normal;
 				hitRecord.didHit = true;
-				return true;
 			}
-			return false;
+			return true;
 		}
 
+		//Occlusion only
 		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Triangle(triangle, ray, temp, true);
+			float t{};
+			return HitTest_Triangle(PrecomputedTriangle{ triangle.v0, triangle.v1, triangle.v2 }, triangle.cullMode, ray, t);
 		}
 #pragma endregion
 #pragma region TriangeMesh SlabTest
@@ -163,37 +229,350 @@ namespace dae
 			return tmax > 0 && tmax >= tmin;
 		}
 #pragma endregion
-#pragma region TriangeMesh HitTest
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+#pragma region BVH Traversal
+		//Returns the entry distance of the ray into the box, FLT_MAX on a miss
+		inline float SlabTest_AABB(const AABB& aabb, const Ray& ray, const Vector3& invDirection)
 		{
-			if (!SlabTest_TriangleMesh(mesh, ray))
+			const float tx1{ (aabb.min.x - ray.origin.x) * invDirection.x };
+			const float tx2{ (aabb.max.x - ray.origin.x) * invDirection.x };
+
+			float tmin{ std::min(tx1, tx2) };
+			float tmax{ std::max(tx1, tx2) };
+
+			const float ty1{ (aabb.min.y - ray.origin.y) * invDirection.y };
+			const float ty2{ (aabb.max.y - ray.origin.y) * invDirection.y };
+
+			tmin = std::max(tmin, std::min(ty1, ty2));
+			tmax = std::min(tmax, std::max(ty1, ty2));
+
+			const float tz1{ (aabb.min.z - ray.origin.z) * invDirection.z };
+			const float tz2{ (aabb.max.z - ray.origin.z) * invDirection.z };
+
+			tmin = std::max(tmin, std::min(tz1, tz2));
+			tmax = std::min(tmax, std::max(tz1, tz2));
+
+			if (tmax >= tmin && tmax >= ray.min && tmin <= ray.max)
+				return tmin;
+			return FLT_MAX;
+		}
+
+		/**
+		 * \brief Walks the hierarchy front-to-back, skipping every node that starts beyond ray.max
+		 * \param bvh hierarchy to traverse
+		 * \param ray ray to trace, hitTest is expected to shrink ray.max when it accepts a closer hit
+		 * \param hitTest callable (uint32_t primitiveIndex, Ray& ray) -> bool
+		 * \return true if any primitive reported a hit
+		 */
+		template<typename HitTestFunction>
+		inline bool Traverse_BVH(const BVH& bvh, Ray& ray, HitTestFunction&& hitTest)
+		{
+			if (bvh.IsEmpty())
+				return false;
+
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			const std::vector<uint32_t>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+			const Vector3 invDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			struct StackEntry
 			{
+				uint32_t nodeIndex;
+				float tEntry;
+			};
+			StackEntry stack[BVH::MaxStackSize]{};
+			int stackSize{ 0 };
+
+			const float tRoot{ SlabTest_AABB(nodes[0].bounds, ray, invDirection) };
+			if (tRoot == FLT_MAX)
 				return false;
+			stack[stackSize++] = { 0, tRoot };
+
+			bool didHit{ false };
+			while (stackSize > 0)
+			{
+				const StackEntry entry{ stack[--stackSize] };
+				if (entry.tEntry > ray.max)
+					continue;
+
+				const BVHNode& node{ nodes[entry.nodeIndex] };
+				if (node.IsLeaf())
+				{
+					for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+					{
+						if (hitTest(primitiveIndices[node.leftFirst + i], ray))
+							didHit = true;
+					}
+					continue;
+				}
+
+				//Visit the nearest child first so ray.max shrinks before the far child is considered
+				uint32_t nearIndex{ node.leftFirst };
+				uint32_t farIndex{ node.leftFirst + 1 };
+				float tNear{ SlabTest_AABB(nodes[nearIndex].bounds, ray, invDirection) };
+				float tFar{ SlabTest_AABB(nodes[farIndex].bounds, ray, invDirection) };
+				if (tFar < tNear)
+				{
+					std::swap(nearIndex, farIndex);
+					std::swap(tNear, tFar);
+				}
+
+				if (tFar != FLT_MAX)
+					stack[stackSize++] = { farIndex, tFar };
+				if (tNear != FLT_MAX)
+					stack[stackSize++] = { nearIndex, tNear };
 			}
+			return didHit;
+		}
 
-			for (int i = 0; i < mesh.indices.size(); i += 3)
+		/**
+		 * \brief Occlusion traversal, stops at the first primitive that reports a hit
+		 * \param bvh hierarchy to traverse
+		 * \param ray ray to test, its range is never changed
+		 * \param hitTest callable (uint32_t primitiveIndex) -> bool
+		 * \return true as soon as any primitive is hit
+		 */
+		template<typename HitTestFunction>
+		inline bool Traverse_BVH_AnyHit(const BVH& bvh, const Ray& ray, HitTestFunction&& hitTest)
+		{
+			if (bvh.IsEmpty())
+				return false;
+
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			const std::vector<uint32_t>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+			const Vector3 invDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			//Any hit will do, so children are not sorted and entry distances are not kept
+			uint32_t stack[BVH::MaxStackSize]{};
+			int stackSize{ 0 };
+			stack[stackSize++] = 0;
+
+			while (stackSize > 0)
 			{
-				Triangle triangle{
-					mesh.transformedPositions[mesh.indices[i]], mesh.transformedPositions[mesh.indices[i + 1]],
-					mesh.transformedPositions[mesh.indices[i + 2]], mesh.transformedNormals[i / 3]
-				};
-				triangle.cullMode = mesh.cullMode;
-				triangle.materialIndex = mesh.materialIndex;
-
-				if (HitTest_Triangle(triangle, ray, hitRecord))
+				const BVHNode& node{ nodes[stack[--stackSize]] };
+				if (SlabTest_AABB(node.bounds, ray, invDirection) == FLT_MAX)
+					continue;
+
+				if (node.IsLeaf())
 				{
-					return true;
+					for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+					{
+						if (hitTest(primitiveIndices[node.leftFirst + i]))
+							return true;
+					}
+					continue;
 				}
+
+				stack[stackSize++] = node.leftFirst + 1;
+				stack[stackSize++] = node.leftFirst;
 			}
 			return false;
 		}
+#pragma endregion
+#pragma region TriangeMesh HitTest
+		//Closest triangle of the mesh within the ray range, only its distance, index and barycentrics are kept
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, TriangleCullMode cullMode, const Ray& ray, PrimitiveHit& hit)
+		{
+			Ray meshRay{ ray };
+			return Traverse_BVH(mesh.bvh, meshRay, [&](uint32_t triangleIndex, Ray& r)
+				{
+					if (!HitTest_Triangle(mesh.triangles[triangleIndex], cullMode, r, hit.t, hit.u, hit.v))
+						return false;
+
+					r.max = hit.t;
+					hit.primitiveIndex = triangleIndex;
+					return true;
+				});
+		}
+
+		inline void ResolveHit_TriangleMesh(const TriangleMesh& mesh, unsigned char materialIndex, const Ray& ray, const PrimitiveHit& hit, HitRecord& hitRecord)
+		{
+			hitRecord.origin = ray.origin + hit.t * ray.direction;
+			hitRecord.t = hit.t;
+			hitRecord.materialIndex = materialIndex;
+			hitRecord.normal = mesh.triangles[hit.primitiveIndex].normal;
+			hitRecord.didHit = true;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, TriangleCullMode cullMode, unsigned char materialIndex, const Ray& ray, HitRecord& hitRecord)
+		{
+			PrimitiveHit hit{};
+			if (!HitTest_TriangleMesh(mesh, cullMode, ray, hit))
+				return false;
+
+			ResolveHit_TriangleMesh(mesh, materialIndex, ray, hit, hitRecord);
+			return true;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord)
+		{
+			return HitTest_TriangleMesh(mesh, mesh.cullMode, mesh.materialIndex, ray, hitRecord);
+		}
+
+		//Occlusion only, the cull mode is passed in so instances can override it
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, TriangleCullMode cullMode, const Ray& ray)
+		{
+			return Traverse_BVH_AnyHit(mesh.bvh, ray, [&](uint32_t triangleIndex)
+				{
+					float t{};
+					return HitTest_Triangle(mesh.triangles[triangleIndex], cullMode, ray, t);
+				});
+		}
 
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_TriangleMesh(mesh, ray, temp, true);
+			return HitTest_TriangleMesh(mesh, mesh.cullMode, ray);
 		}
 
+#pragma endregion
+#pragma region TriangleMeshInstance HitTest
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray, PrimitiveHit& hit)
+		{
+			//The direction is not renormalized, which keeps t identical in object and world space
+			const Ray objectRay{
+				instance.worldToObject.TransformPoint(ray.origin),
+				instance.worldToObject.TransformVector(ray.direction),
+				ray.min, ray.max
+			};
+
+			return HitTest_TriangleMesh(*instance.pMesh, instance.cullMode, objectRay, hit);
+		}
+
+		inline void ResolveHit_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray, const PrimitiveHit& hit, HitRecord& hitRecord)
+		{
+			hitRecord.origin = ray.origin + hit.t * ray.direction;
+			hitRecord.t = hit.t;
+			hitRecord.materialIndex = instance.materialIndex;
+			hitRecord.normal = instance.normalToWorld.TransformVector(instance.pMesh->triangles[hit.primitiveIndex].normal).Normalized();
+			hitRecord.didHit = true;
+		}
+
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			PrimitiveHit hit{};
+			if (!HitTest_TriangleMeshInstance(instance, ray, hit))
+				return false;
+
+			if (!ignoreHitRecord)
+				ResolveHit_TriangleMeshInstance(instance, ray, hit, hitRecord);
+			return true;
+		}
+
+		//Occlusion only
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray)
+		{
+			const Ray objectRay{
+				instance.worldToObject.TransformPoint(ray.origin),
+				instance.worldToObject.TransformVector(ray.direction),
+				ray.min, ray.max
+			};
+
+			return HitTest_TriangleMesh(*instance.pMesh, instance.cullMode, objectRay);
+		}
+#pragma endregion
+#pragma region Packet HitTests
+		//RAY PACKET HIT-TESTS
+		//Same math as the scalar tests, evaluated for all four lanes at once
+		//The primitive kernels live in RenderScene, they return a bit mask of the lanes that accepted a closer hit
+		inline __m128 Dot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+		}
+
+		//Entry distance of every lane into the box, FLT_MAX for the lanes that miss it
+		inline __m128 SlabTest_AABB(const AABB& aabb, const RayPacket4& packet)
+		{
+			const __m128 tx1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.min.x), packet.originX), packet.invDirectionX) };
+			const __m128 tx2{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.max.x), packet.originX), packet.invDirectionX) };
+
+			__m128 tmin{ _mm_min_ps(tx1, tx2) };
+			__m128 tmax{ _mm_max_ps(tx1, tx2) };
+
+			const __m128 ty1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.min.y), packet.originY), packet.invDirectionY) };
+			const __m128 ty2{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.max.y), packet.originY), packet.invDirectionY) };
+
+			tmin = _mm_max_ps(tmin, _mm_min_ps(ty1, ty2));
+			tmax = _mm_min_ps(tmax, _mm_max_ps(ty1, ty2));
+
+			const __m128 tz1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.min.z), packet.originZ), packet.invDirectionZ) };
+			const __m128 tz2{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb.max.z), packet.originZ), packet.invDirectionZ) };
+
+			tmin = _mm_max_ps(tmin, _mm_min_ps(tz1, tz2));
+			tmax = _mm_min_ps(tmax, _mm_max_ps(tz1, tz2));
+
+			const __m128 isHit{ _mm_and_ps(_mm_cmpge_ps(tmax, tmin),
+				_mm_and_ps(_mm_cmpge_ps(tmax, packet.min), _mm_cmple_ps(tmin, packet.max))) };
+			return RayPacket4::Select(isHit, tmin, _mm_set1_ps(FLT_MAX));
+		}
+
+		/**
+		 * \brief Walks the hierarchy with the whole packet, a node is visited while at least one lane still reaches it
+		 * \param bvh hierarchy to traverse
+		 * \param packet rays to trace, hitTest is expected to shrink the max of the lanes it accepts a closer hit for
+		 * \param hitTest callable (uint32_t primitiveIndex, RayPacket4& packet, int laneMask) -> int, returns the mask of lanes that hit
+		 * \return mask of the lanes that hit any primitive
+		 */
+		template<typename HitTestFunction>
+		inline int Traverse_BVH(const BVH& bvh, RayPacket4& packet, HitTestFunction&& hitTest)
+		{
+			if (bvh.IsEmpty() || packet.activeMask == 0)
+				return 0;
+
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			const std::vector<uint32_t>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+
+			struct StackEntry
+			{
+				uint32_t nodeIndex;
+				__m128 tEntry;
+			};
+			StackEntry stack[BVH::MaxStackSize]{};
+			int stackSize{ 0 };
+
+			stack[stackSize++] = { 0, SlabTest_AABB(nodes[0].bounds, packet) };
+
+			int hitMask{ 0 };
+			while (stackSize > 0)
+			{
+				const StackEntry entry{ stack[--stackSize] };
+
+				//Lanes that missed this node, or found a hit in front of it since it was pushed, drop out here
+				//A miss is FLT_MAX, which would pass the max test of a lane that has not hit anything yet
+				const __m128 entersNode{ _mm_and_ps(_mm_cmple_ps(entry.tEntry, packet.max), _mm_cmplt_ps(entry.tEntry, _mm_set1_ps(FLT_MAX))) };
+				const int laneMask{ _mm_movemask_ps(entersNode) & packet.activeMask };
+				if (laneMask == 0)
+					continue;
+
+				const BVHNode& node{ nodes[entry.nodeIndex] };
+				if (node.IsLeaf())
+				{
+					for (uint32_t i{ 0 }; i < node.primitiveCount; ++i)
+					{
+						hitMask |= hitTest(primitiveIndices[node.leftFirst + i], packet, laneMask);
+					}
+					continue;
+				}
+
+				//The child most lanes enter first is visited first
+				uint32_t nearIndex{ node.leftFirst };
+				uint32_t farIndex{ node.leftFirst + 1 };
+				__m128 tNear{ SlabTest_AABB(nodes[nearIndex].bounds, packet) };
+				__m128 tFar{ SlabTest_AABB(nodes[farIndex].bounds, packet) };
+
+				const int nearFirstMask{ _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & laneMask };
+				const int farFirstMask{ _mm_movemask_ps(_mm_cmplt_ps(tFar, tNear)) & laneMask };
+				if (RayPacket4::CountLanes(farFirstMask) > RayPacket4::CountLanes(nearFirstMask))
+				{
+					std::swap(nearIndex, farIndex);
+					std::swap(tNear, tFar);
+				}
+
+				const __m128 noHit{ _mm_set1_ps(FLT_MAX) };
+				if (_mm_movemask_ps(_mm_cmplt_ps(tFar, noHit)) & laneMask)
+					stack[stackSize++] = { farIndex, tFar };
+				if (_mm_movemask_ps(_mm_cmplt_ps(tNear, noHit)) & laneMask)
+					stack[stackSize++] = { nearIndex, tNear };
+			}
+			return hitMask;
+		}
 #pragma endregion
 	}
 
@@ -226,78 +605,204 @@ namespace dae
 			}
 			
 		}
-	}
 
-	namespace Utils
-	{
-		//Just parses vertices and indices
-#pragma warning(push)
-#pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		//Single point on a light as seen from a shaded point, not yet tested for occlusion
+		struct LightSample
 		{
-			std::ifstream file(filename);
-			if (!file)
-				return false;
+			Vector3 direction{}; //Unit vector from the shaded point towards the sample
+			float distance{};
+			ColorRGB radiance{}; //Radiance arriving at the shaded point, for point and directional lights the radiance of the whole light
+			float pdf{ 1.f }; //Solid angle density the direction was picked with, 1 for point and directional lights
+		};
+
+		//Area lights are Lambertian emitters, their radiance is picked so that facing them from a distance gives the same light as a point light of equal intensity
+		inline ColorRGB GetAreaLightRadiance(const Light& light)
+		{
+			const float area{ light.type == LightType::AreaRect ? light.width * light.height : PI * light.height * light.height };
+			return light.color * (light.intensity / area);
+		}
 
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
-			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
-				//use conditional statements to process the different commands	
-				if (sCommand == "#")
-				{
-					// Ignore Comment
-				}
-				else if (sCommand == "v")
-				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
-				}
-				else if (sCommand == "f")
-				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
+		//Two vectors that form an orthonormal basis with the unit vector n (Duff et al. 2017)
+		inline void CreateOrthonormalBasis(const Vector3& n, Vector3& tangent, Vector3& bitangent)
+		{
+			const float sign{ std::copysign(1.f, n.z) };
+			const float a{ -1.f / (sign + n.z) };
+			const float b{ n.x * n.y * a };
+			tangent = Vector3{ 1.f + sign * n.x * n.x * a, sign * b, -sign * n.x };
+			bitangent = Vector3{ b, sign + n.y * n.y * a, -n.y };
+		}
 
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
-				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
+		//Maps the unit square onto the unit disk keeping neighbouring samples together (Shirley-Chiu concentric mapping)
+		//Stratified (u, v) stay stratified on the disk, unlike with the polar sqrt(u), 2 * PI * v mapping
+		inline void ConcentricSampleDisk(float u, float v, float& x, float& y)
+		{
+			const float offsetU{ 2.f * u - 1.f };
+			const float offsetV{ 2.f * v - 1.f };
+			if (offsetU == 0.f && offsetV == 0.f)
+			{
+				x = 0.f;
+				y = 0.f;
+				return;
+			}
 
-				if (file.eof())
-					break;
+			float radius{};
+			float theta{};
+			if (std::abs(offsetU) > std::abs(offsetV))
+			{
+				radius = offsetU;
+				theta = (PI / 4.f) * (offsetV / offsetU);
 			}
+			else
+			{
+				radius = offsetV;
+				theta = (PI / 2.f) - (PI / 4.f) * (offsetU / offsetV);
+			}
+			x = radius * std::cos(theta);
+			y = radius * std::sin(theta);
+		}
+
+		//Turns a point picked uniformly on a flat light of the given area into a solid angle sample
+		inline LightSample CreateAreaSample(const Light& light, const Vector3& target, const Vector3& samplePoint, float area)
+		{
+			const Vector3 toLight{ samplePoint - target };
+			const float distanceSq{ toLight.SqrMagnitude() };
+			const float distance{ std::sqrt(distanceSq) };
+			const Vector3 direction{ toLight * (1.f / distance) };
+
+			//Flat lights emit from both sides
+			const float lightCos{ std::abs(Vector3::Dot(light.normal, direction)) };
+			if (lightCos <= 0.f)
+				return LightSample{ direction, distance, {}, 0.f };
+
+			return LightSample{ direction, distance, GetAreaLightRadiance(light), distanceSq / (area * lightCos) };
+		}
+
+		inline LightSample SampleRectLight(const Light& light, const Vector3& target, float u, float v)
+		{
+			const Vector3 samplePoint{ light.origin + (u - 0.5f) * light.width * light.right + (v - 0.5f) * light.height * light.up };
+			return CreateAreaSample(light, target, samplePoint, light.width * light.height);
+		}
+
+		inline LightSample SampleDiskLight(const Light& light, const Vector3& target, float u, float v)
+		{
+			float x{};
+			float y{};
+			ConcentricSampleDisk(u, v, x, y);
+
+			const float radius{ light.height };
+			const Vector3 samplePoint{ light.origin + (x * radius) * light.right + (y * radius) * light.up };
+			return CreateAreaSample(light, target, samplePoint, PI * radius * radius);
+		}
 
-			//Precompute normals
-			for (uint64_t index = 0; index < indices.size(); index += 3)
+		//Samples the cone of directions in which the sphere is visible, so every sample lands on the side facing the target
+		inline LightSample SampleSphereLight(const Light& light, const Vector3& target, float u, float v)
+		{
+			const float radius{ light.height };
+			const Vector3 toCenter{ light.origin - target };
+			const float centerDistanceSq{ toCenter.SqrMagnitude() };
+
+			//Inside the sphere every direction sees it, pick a point on the whole surface instead
+			if (centerDistanceSq <= radius * radius)
 			{
-				uint32_t i0 = indices[index];
-				uint32_t i1 = indices[index + 1];
-				uint32_t i2 = indices[index + 2];
+				const float z{ 1.f - 2.f * v };
+				const float r{ std::sqrt(std::max(0.f, 1.f - z * z)) };
+				const float phi{ 2.f * PI * u };
+				const Vector3 normal{ r * std::cos(phi), r * std::sin(phi), z };
+				const Vector3 samplePoint{ light.origin + radius * normal };
+
+				const Vector3 toLight{ samplePoint - target };
+				const float distanceSq{ toLight.SqrMagnitude() };
+				const float distance{ std::sqrt(distanceSq) };
+				const Vector3 direction{ toLight * (1.f / distance) };
+				const float lightCos{ std::abs(Vector3::Dot(normal, direction)) };
+				if (lightCos <= 0.f)
+					return LightSample{ direction, distance, {}, 0.f };
+
+				return LightSample{ direction, distance, GetAreaLightRadiance(light), distanceSq / (4.f * PI * radius * radius * lightCos) };
+			}
 
-				Vector3 edgeV0V1 = positions[i1] - positions[i0];
-				Vector3 edgeV0V2 = positions[i2] - positions[i0];
-				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
+			const float centerDistance{ std::sqrt(centerDistanceSq) };
+			const Vector3 axis{ toCenter * (1.f / centerDistance) };
 
-				if (isnan(normal.x))
-				{
-					int k = 0;
-				}
+			//1 - cos written as sin^2 / (1 + cos), which stays accurate for small, distant lights
+			const float sinThetaMaxSq{ radius * radius / centerDistanceSq };
+			const float cosThetaMax{ std::sqrt(1.f - sinThetaMaxSq) };
+			const float oneMinusCosThetaMax{ sinThetaMaxSq / (1.f + cosThetaMax) };
 
-				normal.Normalize();
-				if (isnan(normal.x))
-				{
-					int k = 0;
-				}
+			const float oneMinusCosTheta{ u * oneMinusCosThetaMax };
+			const float cosTheta{ 1.f - oneMinusCosTheta };
+			const float sinThetaSq{ oneMinusCosTheta * (2.f - oneMinusCosTheta) };
+			const float sinTheta{ std::sqrt(sinThetaSq) };
+			const float phi{ 2.f * PI * v };
 
-				normals.push_back(normal);
+			Vector3 tangent{};
+			Vector3 bitangent{};
+			CreateOrthonormalBasis(axis, tangent, bitangent);
+			const Vector3 direction{ (sinTheta * std::cos(phi)) * tangent + (sinTheta * std::sin(phi)) * bitangent + cosTheta * axis };
+
+			//Distance to the near side of the sphere along the sampled direction
+			const float distance{ centerDistance * cosTheta - std::sqrt(std::max(0.f, radius * radius - centerDistanceSq * sinThetaSq)) };
+			return LightSample{ direction, distance, GetAreaLightRadiance(light), 1.f / (2.f * PI * oneMinusCosThetaMax) };
+		}
+
+		/**
+		 * \brief Picks a point on a light, (u, v) are mapped onto the surface of area lights and ignored for point and directional lights
+		 * \param target point being shaded
+		 * \param u, v sample coordinates in [0, 1), stratified coordinates give stratified samples on the light
+		 */
+		inline LightSample SampleLight(const Light& light, const Vector3& target, float u, float v)
+		{
+			switch (light.type)
+			{
+			case LightType::AreaRect:
+				return SampleRectLight(light, target, u, v);
+			case LightType::AreaCircle:
+				return SampleDiskLight(light, target, u, v);
+			case LightType::AreaSphere:
+				return SampleSphereLight(light, target, u, v);
+			default:
+			{
+				const Vector3 toLight{ light.origin - target };
+				const float distanceSq{ toLight.SqrMagnitude() };
+				const float distance{ std::sqrt(distanceSq) };
+				return LightSample{ toLight * (1.f / distance), distance, light.color * (light.intensity / distanceSq), 1.f };
+			}
+			}
+		}
+
+		inline bool IsAreaLight(const Light& light)
+		{
+			return light.type == LightType::AreaRect || light.type == LightType::AreaCircle || light.type == LightType::AreaSphere;
+		}
+	}
+
+	namespace Utils
+	{
+		//Parses the positions and faces, one geometric normal is calculated per triangle
+		//The file is memory-mapped and parsed in parallel chunks when a thread pool is given, see ObjLoader
+#pragma warning(push)
+#pragma warning(disable : 4505) //Warning unreferenced local function
+		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices,
+			ThreadPool* pThreadPool = nullptr)
+		{
+			return ObjLoader::Load(filename, positions, normals, indices, pThreadPool);
+		}
+
+		//Fills an empty mesh from the binary cache of the OBJ file and only parses the OBJ when that cache is missing or outdated
+		//A parsed mesh writes a new cache, so the next start skips the parsing and the BVH build
+		static bool LoadOBJMesh(const std::string& filename, TriangleMesh& mesh, ThreadPool* pThreadPool = nullptr)
+		{
+			if (MeshCache::Load(filename, mesh))
+			{
+				mesh.UpdateTransforms(pThreadPool);
+				return true;
 			}
 
+			if (!ParseOBJ(filename, mesh.positions, mesh.normals, mesh.indices, pThreadPool))
+				return false;
+
+			mesh.UpdateTransforms(pThreadPool);
+			MeshCache::Save(filename, mesh);
 			return true;
 		}
 #pragma warning(pop)
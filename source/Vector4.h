@@ -1,32 +1,115 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+#include <xmmintrin.h>
 
 namespace dae
 {
 	struct Vector3;
-	struct Vector4
+
+	//16-byte aligned so it can be loaded into a single SSE register, the rows of a Matrix are Vector4s
+	struct alignas(16) Vector4
 	{
-		float x;
-		float y;
-		float z;
-		float w;
-
-		Vector4() = default;
-		Vector4(float _x, float _y, float _z, float _w);
-		Vector4(const Vector3& v, float _w);
-
-		float Magnitude() const;
-		float SqrMagnitude() const;
-		float Normalize();
-		Vector4 Normalized() const;
-
-		static float Dot(const Vector4& v1, const Vector4& v2);
-
-		// operator overloading
-		Vector4 operator*(float scale) const;
-		Vector4 operator+(const Vector4& v) const;
-		Vector4 operator-(const Vector4& v) const;
-		Vector4& operator+=(const Vector4& v);
-		float& operator[](int index);
-		float operator[](int index) const;
+		float x{};
+		float y{};
+		float z{};
+		float w{};
+
+		constexpr Vector4() = default;
+		constexpr Vector4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+		constexpr Vector4(const Vector3& v, float _w);
+
+		float Magnitude() const
+		{
+			return sqrtf(SqrMagnitude());
+		}
+
+		constexpr float SqrMagnitude() const
+		{
+			return x * x + y * y + z * z + w * w;
+		}
+
+		float Normalize()
+		{
+			const float m = Magnitude();
+			x /= m;
+			y /= m;
+			z /= m;
+			w /= m;
+
+			return m;
+		}
+
+		Vector4 Normalized() const
+		{
+			const float m = Magnitude();
+			return { x / m, y / m, z / m, w / m };
+		}
+
+		static constexpr float Dot(const Vector4& v1, const Vector4& v2)
+		{
+			return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z + v1.w * v2.w;
+		}
+
+		__m128 Load() const
+		{
+			return _mm_load_ps(&x);
+		}
+
+		static Vector4 Store(__m128 v)
+		{
+			Vector4 result{};
+			_mm_store_ps(&result.x, v);
+			return result;
+		}
+
+#pragma region Operator Overloads
+		constexpr Vector4 operator*(float scale) const
+		{
+			return { x * scale, y * scale, z * scale, w * scale };
+		}
+
+		constexpr Vector4 operator+(const Vector4& v) const
+		{
+			return { x + v.x, y + v.y, z + v.z, w + v.w };
+		}
+
+		constexpr Vector4 operator-(const Vector4& v) const
+		{
+			return { x - v.x, y - v.y, z - v.z, w - v.w };
+		}
+
+		constexpr Vector4& operator+=(const Vector4& v)
+		{
+			x += v.x;
+			y += v.y;
+			z += v.z;
+			w += v.w;
+			return *this;
+		}
+
+		constexpr float& operator[](int index)
+		{
+			assert(index <= 3 && index >= 0);
+
+			if (index == 0)return x;
+			if (index == 1)return y;
+			if (index == 2)return z;
+			return w;
+		}
+
+		constexpr float operator[](int index) const
+		{
+			assert(index <= 3 && index >= 0);
+
+			if (index == 0)return x;
+			if (index == 1)return y;
+			if (index == 2)return z;
+			return w;
+		}
+#pragma endregion
 	};
 }
+
+//Defines the conversions between Vector3 and Vector4, whichever of the two headers is included first
+#include "Vector3.h"
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Work queues of the wavefront renderer, every stage consumes one queue and fills the next
+	//Queues are cleared instead of freed between tiles, after the first tiles a thread renders no longer allocates
+	struct WavefrontQueues
+	{
+		//Primary rays of a tile, generated in 2x2 pixel blocks so every 4 consecutive rays form a coherent packet
+		//All of them start at the camera origin, only the directions are stored
+		struct RayQueue
+		{
+			AlignedVector<float> directionX{};
+			AlignedVector<float> directionY{};
+			AlignedVector<float> directionZ{};
+			AlignedVector<uint32_t> pixelIndex{};
+
+			uint32_t GetSize() const { return static_cast<uint32_t>(pixelIndex.size()); }
+
+			void Clear()
+			{
+				directionX.clear();
+				directionY.clear();
+				directionZ.clear();
+				pixelIndex.clear();
+			}
+
+			void Push(const Vector3& direction, uint32_t pixel)
+			{
+				directionX.push_back(direction.x);
+				directionY.push_back(direction.y);
+				directionZ.push_back(direction.z);
+				pixelIndex.push_back(pixel);
+			}
+		};
+
+		//Primary rays that hit something, misses never reach the shading stage
+		struct HitQueue
+		{
+			std::vector<HitRecord> hits{};
+			std::vector<uint32_t> raySlot{}; //Index of the primary ray in the ray queue
+
+			uint32_t GetSize() const { return static_cast<uint32_t>(raySlot.size()); }
+
+			void Clear()
+			{
+				hits.clear();
+				raySlot.clear();
+			}
+		};
+
+		//Light samples that passed shading, their contribution is added to the ray slot when the shadow ray reaches the light
+		struct ShadowRayQueue
+		{
+			AlignedVector<float> originX{};
+			AlignedVector<float> originY{};
+			AlignedVector<float> originZ{};
+			AlignedVector<float> directionX{};
+			AlignedVector<float> directionY{};
+			AlignedVector<float> directionZ{};
+			AlignedVector<float> distance{};
+			AlignedVector<float> contributionR{};
+			AlignedVector<float> contributionG{};
+			AlignedVector<float> contributionB{};
+			AlignedVector<uint32_t> raySlot{};
+
+			uint32_t GetSize() const { return static_cast<uint32_t>(raySlot.size()); }
+
+			void Clear()
+			{
+				originX.clear();
+				originY.clear();
+				originZ.clear();
+				directionX.clear();
+				directionY.clear();
+				directionZ.clear();
+				distance.clear();
+				contributionR.clear();
+				contributionG.clear();
+				contributionB.clear();
+				raySlot.clear();
+			}
+
+			void Push(const Vector3& origin, const Vector3& direction, float maxDistance, const ColorRGB& contribution, uint32_t slot)
+			{
+				originX.push_back(origin.x);
+				originY.push_back(origin.y);
+				originZ.push_back(origin.z);
+				directionX.push_back(direction.x);
+				directionY.push_back(direction.y);
+				directionZ.push_back(direction.z);
+				distance.push_back(maxDistance);
+				contributionR.push_back(contribution.r);
+				contributionG.push_back(contribution.g);
+				contributionB.push_back(contribution.b);
+				raySlot.push_back(slot);
+			}
+		};
+
+		RayQueue rays{};
+		HitQueue hits{};
+		ShadowRayQueue shadowRays{};
+		std::vector<ColorRGB> radiance{}; //Per ray slot, summed over the shading and shadow stages
+
+		void Clear()
+		{
+			rays.Clear();
+			hits.Clear();
+			shadowRays.Clear();
+			radiance.clear();
+		}
+	};
+}
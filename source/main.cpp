@@ -5,38 +5,215 @@
 #undef main
 
 //Standard includes
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <string>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "SphereKernels.h"
 
 using namespace dae;
 
+struct LaunchOptions
+{
+	bool headless{ false };
+	std::string sceneName{ "reference" };
+	int width{ 640 };
+	int height{ 480 };
+	int numFrames{ 1 };
+	std::string outputPath{ "RayTracing_Frame" };
+	uint32_t numThreads{ 0 };
+	bool pinThreads{ false };
+	int tileSize{ 32 };
+	bool usePackets{ true };
+	bool useWavefront{ false };
+	Renderer::DirectLightingMode directLightingMode{ Renderer::DirectLightingMode::AllLights };
+	Renderer::AdaptiveShadowSettings adaptiveShadows{};
+};
+
+void PrintUsage()
+{
+	std::cout << "Usage: RayTracer [options]\n"
+		<< "  --headless          render without a window and write every frame to disk\n"
+		<< "  --scene <name>      w1, w2, w3, w4, reference, bunny, random, arealight, grazing, test\n"
+		<< "  --width <pixels>    framebuffer width (default 640)\n"
+		<< "  --height <pixels>   framebuffer height (default 480)\n"
+		<< "  --frames <count>    number of frames to render in headless mode (default 1)\n"
+		<< "  --output <prefix>   output path prefix, frames are saved as <prefix>_0000.bmp\n"
+		<< "  --threads <count>   number of render threads (default: all cores)\n"
+		<< "  --pin               pin every render thread to its own core\n"
+		<< "  --tile-size <size>  tile size in pixels (default 32)\n"
+		<< "  --no-packets        trace primary rays one by one instead of in 2x2 SSE packets\n"
+		<< "  --wavefront         render every tile stage by stage through ray queues\n"
+		<< "  --lights <mode>     direct lighting: all, tree, restir (default all)\n"
+		<< "  --no-adaptive-shadows       trace a shadow ray for every area light sample on the first frame after a reset\n"
+		<< "  --shadow-samples <i> <max>  initial shadow rays and light samples per area light (default 2 12)\n"
+		<< "  --penumbra-threshold <f>    fraction of initial shadow rays that may disagree before refining (default 0)\n";
+}
+
+bool ParseArguments(int argc, char* args[], LaunchOptions& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string argument{ args[i] };
+		const bool hasValue{ i + 1 < argc };
+
+		if (argument == "--headless")
+			options.headless = true;
+		else if (argument == "--pin")
+			options.pinThreads = true;
+		else if (argument == "--no-packets")
+			options.usePackets = false;
+		else if (argument == "--wavefront")
+			options.useWavefront = true;
+		else if (argument == "--no-adaptive-shadows")
+			options.adaptiveShadows.enabled = false;
+		else if (argument == "--shadow-samples" && i + 2 < argc)
+		{
+			options.adaptiveShadows.initialSamples = std::atoi(args[++i]);
+			options.adaptiveShadows.maxSamples = std::atoi(args[++i]);
+		}
+		else if (argument == "--penumbra-threshold" && hasValue)
+			options.adaptiveShadows.penumbraThreshold = static_cast<float>(std::atof(args[++i]));
+		else if (argument == "--scene" && hasValue)
+			options.sceneName = args[++i];
+		else if (argument == "--width" && hasValue)
+			options.width = std::atoi(args[++i]);
+		else if (argument == "--height" && hasValue)
+			options.height = std::atoi(args[++i]);
+		else if (argument == "--frames" && hasValue)
+			options.numFrames = std::atoi(args[++i]);
+		else if (argument == "--output" && hasValue)
+			options.outputPath = args[++i];
+		else if (argument == "--threads" && hasValue)
+			options.numThreads = static_cast<uint32_t>(std::atoi(args[++i]));
+		else if (argument == "--tile-size" && hasValue)
+			options.tileSize = std::atoi(args[++i]);
+		else if (argument == "--lights" && hasValue)
+		{
+			const std::string mode{ args[++i] };
+			if (mode == "all")
+				options.directLightingMode = Renderer::DirectLightingMode::AllLights;
+			else if (mode == "tree")
+				options.directLightingMode = Renderer::DirectLightingMode::LightTree;
+			else if (mode == "restir")
+				options.directLightingMode = Renderer::DirectLightingMode::Reservoir;
+			else
+			{
+				std::cout << "Unknown lighting mode: " << mode << std::endl;
+				return false;
+			}
+		}
+		else
+		{
+			std::cout << "Unknown argument: " << argument << std::endl;
+			return false;
+		}
+	}
+
+	return options.width > 0 && options.height > 0 && options.numFrames > 0 && options.tileSize > 0
+		&& options.adaptiveShadows.initialSamples > 0 && options.adaptiveShadows.maxSamples >= options.adaptiveShadows.initialSamples;
+}
+
+Scene* CreateScene(const std::string& sceneName)
+{
+	if (sceneName == "w1") return new Scene_W1();
+	if (sceneName == "w2") return new Scene_W2();
+	if (sceneName == "w3") return new Scene_W3();
+	if (sceneName == "w4") return new Scene_W4();
+	if (sceneName == "reference") return new SceneW4_ReferenceScene();
+	if (sceneName == "bunny") return new Scene_W4_BunnyScene();
+	if (sceneName == "random") return new Scene_Extra_RandomScene();
+	if (sceneName == "arealight") return new Scene_Extra_AreaLight();
+	if (sceneName == "grazing") return new Scene_Extra_GrazingLight();
+	if (sceneName == "test") return new Scene_TEST();
+	return nullptr;
+}
+
+int RunHeadless(const LaunchOptions& options, Scene* pScene)
+{
+	SDL_Init(0);
+
+	const auto pTimer = new Timer();
+	const auto pRenderer = new Renderer(options.width, options.height);
+	if (!pRenderer->HasFramebuffer())
+	{
+		delete pRenderer;
+		delete pTimer;
+		SDL_Quit();
+		return 1;
+	}
+
+	pRenderer->SetThreadCount(options.numThreads, options.pinThreads);
+	pRenderer->SetTileSize(options.tileSize);
+	if (!options.usePackets)
+		pRenderer->TogglePacketTracing();
+	if (options.useWavefront)
+		pRenderer->ToggleWavefront();
+	pRenderer->SetDirectLightingMode(options.directLightingMode);
+	pRenderer->SetAdaptiveShadowSettings(options.adaptiveShadows);
+
+	pScene->SetThreadPool(pRenderer->GetThreadPool());
+	pScene->Initialize();
+
+	std::cout << "Rendering " << options.numFrames << " frame(s) of '" << options.sceneName << "' at "
+		<< options.width << "x" << options.height << " on " << pRenderer->GetThreadCount() << " thread(s), "
+		<< SphereKernels::Select().name << " sphere kernels" << std::endl;
+
+	//Only the render itself is timed, writing the frames to disk is excluded
+	std::chrono::duration<double> totalRenderTime{};
+
+	pTimer->Start();
+	for (int frame = 0; frame < options.numFrames; ++frame)
+	{
+		pScene->Update(pTimer);
+
+		const auto startTime{ std::chrono::steady_clock::now() };
+		pRenderer->Render(pScene);
+		totalRenderTime += std::chrono::steady_clock::now() - startTime;
+
+		pTimer->Update();
+
+		char filePath[512]{};
+		std::snprintf(filePath, sizeof(filePath), "%s_%04d.bmp", options.outputPath.c_str(), frame);
+		if (pRenderer->SaveBufferToImage(filePath))
+			std::cout << "Something went wrong. Frame not saved: " << filePath << std::endl;
+	}
+	pTimer->Stop();
+
+	const double averageMs{ totalRenderTime.count() * 1000.0 / options.numFrames };
+	const double megaPixelsPerSecond{ static_cast<double>(options.width) * options.height * options.numFrames / totalRenderTime.count() / 1e6 };
+	std::cout << "Average frame time: " << averageMs << " ms (" << 1000.0 / averageMs << " FPS, "
+		<< megaPixelsPerSecond << " Mpixels/s)" << std::endl;
+
+	delete pRenderer;
+	delete pTimer;
+
+	SDL_Quit();
+	return 0;
+}
+
 void ShutDown(SDL_Window* pWindow)
 {
 	SDL_DestroyWindow(pWindow);
 	SDL_Quit();
 }
 
-int main(int argc, char* args[])
+int RunWindowed(const LaunchOptions& options, Scene* pScene)
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
-
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
 
-	const uint32_t width = 640;
-	const uint32_t height = 480;
-
 	SDL_Window* pWindow = SDL_CreateWindow(
 		"RayTracer - Bas Ruckebusch (2DAE08)",
 		SDL_WINDOWPOS_UNDEFINED,
 		SDL_WINDOWPOS_UNDEFINED,
-		width, height, 0);
+		options.width, options.height, 0);
 
 	if (!pWindow)
 		return 1;
@@ -44,18 +221,17 @@ int main(int argc, char* args[])
 	//Initialize "framework"
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
+	pRenderer->SetThreadCount(options.numThreads, options.pinThreads);
+	pRenderer->SetTileSize(options.tileSize);
+	if (!options.usePackets)
+		pRenderer->TogglePacketTracing();
+	if (options.useWavefront)
+		pRenderer->ToggleWavefront();
+	pRenderer->SetDirectLightingMode(options.directLightingMode);
+	pRenderer->SetAdaptiveShadowSettings(options.adaptiveShadows);
 
-	// initialise scene
-	// const auto pScene = new Scene_W1();
-	// const auto pScene = new Scene_W2();
-	// const auto pScene = new Scene_W3();
-	// const auto pScene = new Scene_W4();
-	const auto pScene = new SceneW4_ReferenceScene();
-	// const auto pScene = new Scene_W4_BunnyScene();
-	// const auto pScene = new Scene_Extra_RandomScene();
-	//const auto pScene = new Scene_Extra_AreaLight();
-
-	// const auto pScene = new Scene_TEST();
+	//Initialize scene
+	pScene->SetThreadPool(pRenderer->GetThreadPool());
 	pScene->Initialize();
 
 	//Start loop
@@ -83,8 +259,24 @@ int main(int argc, char* args[])
 					pRenderer->TogglShadows();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F3)
 					pRenderer->CycleLightingMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+					pRenderer->CycleDirectLightingMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+					pRenderer->ToggleAdaptiveShadows();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
 					pTimer->StartBenchmark();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+					pRenderer->CycleTileSize();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+					pRenderer->ToggleMultithreading();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+					pRenderer->ToggleAccumulation();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
+					pRenderer->ToggleSamplingMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F11)
+					pRenderer->TogglePacketTracing();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F12)
+					pRenderer->ToggleWavefront();
 				break;
 			}
 		}
@@ -117,10 +309,32 @@ int main(int argc, char* args[])
 	pTimer->Stop();
 
 	//Shutdown "framework"
-	delete pScene;
 	delete pRenderer;
 	delete pTimer;
 
 	ShutDown(pWindow);
 	return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char* args[])
+{
+	LaunchOptions options{};
+	if (!ParseArguments(argc, args, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	// create scene
+	const auto pScene = CreateScene(options.sceneName);
+	if (!pScene)
+	{
+		std::cout << "Unknown scene: " << options.sceneName << std::endl;
+		PrintUsage();
+		return 1;
+	}
+	const int result = options.headless ? RunHeadless(options, pScene) : RunWindowed(options, pScene);
+
+	delete pScene;
+	return result;
+}